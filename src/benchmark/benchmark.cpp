@@ -0,0 +1,119 @@
+#include "benchmark.h"
+#include "camerapath.h"
+#include "parser/affinebatch.h"
+#include "parser/sceneparser.h"
+#include "ui/glwidget.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+QJsonObject summarize(std::vector<double> samples) {
+    QJsonObject summary;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    size_t p99 = (size_t)std::ceil(0.99 * samples.size()) - 1;
+    summary["min"] = samples.front();
+    summary["mean"] = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary["p99"] = samples[p99];
+    summary["max"] = samples.back();
+    return summary;
+}
+
+} // namespace
+
+int runBenchmark(const BenchmarkOptions &options) {
+    RenderData renderData;
+    if (!SceneParser::parse(options.sceneFile, renderData)) {
+        std::cout << "benchmark: could not parse " << options.sceneFile << std::endl;
+        return 1;
+    }
+
+    CameraPath path = CameraPath::fromCamera(renderData.cameraData);
+    if (!options.cameraPathFile.empty() && !path.load(options.cameraPathFile)) {
+        return 1;
+    }
+
+    // A regular widget that is never put on screen; frames are rendered into its framebuffer object
+    GLWidget widget(nullptr);
+    widget.setAttribute(Qt::WA_DontShowOnScreen);
+    widget.setVertexFormat(options.compactVertices ? VertexFormat::VERTEX_COMPACT : VertexFormat::VERTEX_FLOAT);
+    widget.setShapeOrder(options.shapeOrder);
+    widget.resize(options.width, options.height);
+    widget.show();
+    widget.loadScene(renderData);
+    widget.waitForTextures();
+
+    std::vector<double> frameMs;
+    std::vector<double> cpuMs;
+    std::vector<double> gpuMs;
+    double triangles = 0.0;
+    double culled = 0.0;
+    uint32_t drawCalls = 0;
+
+    int total = options.warmupFrames + options.frames;
+    for (int frame = 0; frame < total; frame++) {
+        // Warmup frames replay the start of the path
+        int step = frame < options.warmupFrames ? 0 : frame - options.warmupFrames;
+        CameraPath::Keyframe camera = path.sample(options.frames > 1 ? (float)step / (options.frames - 1) : 0.f);
+
+        QElapsedTimer timer;
+        timer.start();
+        widget.setCamera(camera.pos, camera.look, camera.up);
+        widget.renderFrameNow();
+        double elapsed = timer.nsecsElapsed() / 1e6;
+
+        if (frame < options.warmupFrames) {
+            continue;
+        }
+        const FrameStats &stats = widget.frameStats();
+        frameMs.push_back(elapsed);
+        cpuMs.push_back(stats.cpuMs);
+        if (stats.gpuMs >= 0.0) {
+            gpuMs.push_back(stats.gpuMs);
+        }
+        triangles += (double)stats.triangles;
+        culled += stats.culled;
+        drawCalls = std::max(drawCalls, stats.drawCalls);
+    }
+
+    QJsonObject result;
+    result["scene"] = QString::fromStdString(options.sceneFile);
+    result["cameraPath"] = QString::fromStdString(options.cameraPathFile);
+    result["frames"] = options.frames;
+    result["width"] = options.width;
+    result["height"] = options.height;
+    result["compactVertices"] = options.compactVertices;
+    result["shapeOrder"] = shapeOrderName(options.shapeOrder);
+    result["transformKernels"] = affineBatchInstructionSet();
+    result["frameTimeMs"] = summarize(frameMs);
+    result["cpuTimeMs"] = summarize(cpuMs);
+    result["gpuTimeMs"] = summarize(gpuMs);
+    result["maxDrawCalls"] = (int)drawCalls;
+    result["meanTriangles"] = frameMs.empty() ? 0.0 : triangles / frameMs.size();
+    result["meanCulled"] = frameMs.empty() ? 0.0 : culled / frameMs.size();
+    QByteArray json = QJsonDocument(result).toJson();
+
+    if (options.outputFile.empty()) {
+        std::cout << json.toStdString();
+        return 0;
+    }
+    QFile file(options.outputFile.c_str());
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        std::cout << "benchmark: could not write " << options.outputFile << std::endl;
+        return 1;
+    }
+    file.write(json);
+    return 0;
+}
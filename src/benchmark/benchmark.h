@@ -0,0 +1,22 @@
+#pragma once
+
+#include "parser/shapeorder.h"
+
+#include <string>
+
+struct BenchmarkOptions {
+    std::string sceneFile;
+    std::string cameraPathFile; // Empty to hold the scene's own camera
+    std::string outputFile;     // Empty to write to stdout
+    int frames = 300;
+    int warmupFrames = 10;
+    int width = 1280;
+    int height = 720;
+    bool compactVertices = false;
+    ShapeOrder shapeOrder = ShapeOrder::SHAPE_ORDER_SCENE;
+};
+
+// Renders a scene offscreen along a camera path and reports frame time
+// statistics as JSON. Needs a QApplication; with QT_QPA_PLATFORM=offscreen
+// it runs without a display, e.g. on llvmpipe in CI. Returns a process exit code.
+int runBenchmark(const BenchmarkOptions &options);
@@ -0,0 +1,92 @@
+#include "camerapath.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace {
+
+bool readVec3(const QJsonObject &object, const char *field, glm::vec3 &out) {
+    QJsonArray array = object[field].toArray();
+    if (array.size() != 3) {
+        std::cout << "camera path keyframe field \"" << field << "\" must be an array of 3 numbers" << std::endl;
+        return false;
+    }
+    out = glm::vec3(array[0].toDouble(), array[1].toDouble(), array[2].toDouble());
+    return true;
+}
+
+} // namespace
+
+bool CameraPath::load(const std::string &filename) {
+    m_keyframes.clear();
+
+    QFile file(filename.c_str());
+    if (!file.open(QFile::ReadOnly)) {
+        std::cout << "could not open " << filename << std::endl;
+        return false;
+    }
+
+    QJsonParseError jsonError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &jsonError);
+    if (doc.isNull()) {
+        std::cout << "could not parse " << filename << ": " << jsonError.errorString().toStdString() << std::endl;
+        return false;
+    }
+
+    QJsonArray keyframes = doc.object()["keyframes"].toArray();
+    if (keyframes.isEmpty()) {
+        std::cout << "camera path " << filename << " has no keyframes" << std::endl;
+        return false;
+    }
+
+    for (qsizetype i = 0; i < keyframes.size(); i++) {
+        QJsonObject object = keyframes[i].toObject();
+        Keyframe keyframe;
+        keyframe.time = object.contains("time") ? (float)object["time"].toDouble() : (float)i;
+        if (!readVec3(object, "position", keyframe.pos) || !readVec3(object, "up", keyframe.up)) {
+            return false;
+        }
+        if (object.contains("focus")) {
+            glm::vec3 focus;
+            if (!readVec3(object, "focus", focus)) {
+                return false;
+            }
+            keyframe.look = focus - keyframe.pos;
+        }
+        else if (!readVec3(object, "look", keyframe.look)) {
+            return false;
+        }
+        m_keyframes.push_back(keyframe);
+    }
+
+    std::stable_sort(m_keyframes.begin(), m_keyframes.end(),
+                     [](const Keyframe &a, const Keyframe &b) { return a.time < b.time; });
+    return true;
+}
+
+CameraPath CameraPath::fromCamera(const SceneCameraData &camera) {
+    CameraPath path;
+    path.m_keyframes.push_back(Keyframe{0.f, glm::vec3(camera.pos), glm::vec3(camera.look), glm::vec3(camera.up)});
+    return path;
+}
+
+CameraPath::Keyframe CameraPath::sample(float t) const {
+    if (m_keyframes.size() == 1) {
+        return m_keyframes.front();
+    }
+
+    float time = glm::mix(m_keyframes.front().time, m_keyframes.back().time, glm::clamp(t, 0.f, 1.f));
+    auto next = std::upper_bound(m_keyframes.begin() + 1, m_keyframes.end() - 1, time,
+                                 [](float time, const Keyframe &keyframe) { return time < keyframe.time; });
+    const Keyframe &a = *(next - 1);
+    const Keyframe &b = *next;
+
+    float span = b.time - a.time;
+    float s = span > 0.f ? glm::clamp((time - a.time) / span, 0.f, 1.f) : 1.f;
+    return Keyframe{time, glm::mix(a.pos, b.pos, s), glm::mix(a.look, b.look, s), glm::mix(a.up, b.up, s)};
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "parser/scenedata.h"
+
+#include <string>
+#include <vector>
+
+// A scripted camera move for benchmarks: keyframes in the same terms as
+// SceneCameraData, interpolated linearly in time.
+class CameraPath {
+public:
+    struct Keyframe {
+        float time;
+        glm::vec3 pos;
+        glm::vec3 look;
+        glm::vec3 up;
+    };
+
+    // Loads a path from a JSON file of the form
+    //   {"keyframes": [{"time": 0, "position": [x, y, z], "look": [x, y, z], "up": [x, y, z]}, ...]}
+    // where "focus" may replace "look" as in scene files, and "time" defaults
+    // to the keyframe's index.
+    bool load(const std::string &filename);
+
+    // A path that holds the camera of a scene still.
+    static CameraPath fromCamera(const SceneCameraData &camera);
+
+    // The camera at fraction t, from 0 to 1, of the path's duration.
+    Keyframe sample(float t) const;
+
+    bool isEmpty() const { return m_keyframes.empty(); }
+
+private:
+    std::vector<Keyframe> m_keyframes;
+};
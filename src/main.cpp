@@ -2,9 +2,16 @@
 #include "ui/mainwindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QScreen>
 
+#include <iostream>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "parser/scenefilereader.h"
 #include "parser/sceneparser.h"
+#include "parser/scenevalidator.h"
 
 
 int main(int argc, char *argv[])
@@ -17,6 +24,67 @@ int main(int argc, char *argv[])
     fmt.setProfile(QSurfaceFormat::CoreProfile);
     QSurfaceFormat::setDefaultFormat(fmt);
 
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption benchmarkOption("benchmark", "Render <scene> offscreen and report frame times as JSON.", "scene");
+    QCommandLineOption pathOption("camera-path", "Play the camera keyframes in <file> during the benchmark.", "file");
+    QCommandLineOption framesOption("frames", "Number of measured benchmark frames (default 300).", "count", "300");
+    QCommandLineOption sizeOption("size", "Benchmark framebuffer size (default 1280x720).", "WxH", "1280x720");
+    QCommandLineOption outputOption("output", "Write the benchmark JSON to <file> instead of stdout.", "file");
+    QCommandLineOption compactOption("compact-vertices", "Use the compact vertex format for the benchmark.");
+    QCommandLineOption orderOption("shape-order", "Order of the benchmark's shapes: scene, morton or hilbert (default scene).", "order", "scene");
+    QCommandLineOption cborOption("to-cbor", "Convert the JSON <scene> to CBOR, written to --output or next to it.", "scene");
+    QCommandLineOption validateOption("validate", "Check the given scene files without loading them and report every error.");
+    QCommandLineOption includedOption("included", "With --validate, check the scene files as files included by another scene.");
+    parser.addOptions({benchmarkOption, pathOption, framesOption, sizeOption, outputOption, compactOption, orderOption, cborOption, validateOption, includedOption});
+    parser.addPositionalArgument("scenes", "Scene files to check with --validate.", "[scenes...]");
+    parser.process(a);
+
+    if (parser.isSet(cborOption)) {
+        QString input = parser.value(cborOption);
+        QString output = parser.value(outputOption);
+        if (output.isEmpty()) {
+            output = (input.endsWith(".json") ? input.chopped(5) : input) + ".cbor";
+        }
+        return convertSceneToCbor(input.toStdString(), output.toStdString()) ? 0 : 1;
+    }
+
+    if (parser.isSet(validateOption)) {
+        std::vector<std::string> paths;
+        for (const QString &path : parser.positionalArguments()) {
+            paths.push_back(path.toStdString());
+        }
+        if (paths.empty()) {
+            std::cout << "--validate needs at least one scene file" << std::endl;
+            return 1;
+        }
+        return validateSceneFiles(paths, parser.isSet(includedOption));
+    }
+
+    if (parser.isSet(benchmarkOption)) {
+        BenchmarkOptions options;
+        options.sceneFile = parser.value(benchmarkOption).toStdString();
+        options.cameraPathFile = parser.value(pathOption).toStdString();
+        options.outputFile = parser.value(outputOption).toStdString();
+        options.frames = parser.value(framesOption).toInt();
+        options.compactVertices = parser.isSet(compactOption);
+
+        QStringList size = parser.value(sizeOption).split('x');
+        if (size.size() == 2) {
+            options.width = size[0].toInt();
+            options.height = size[1].toInt();
+        }
+        if (options.frames <= 0 || options.width <= 0 || options.height <= 0) {
+            std::cout << "invalid --frames or --size" << std::endl;
+            return 1;
+        }
+        if (!parseShapeOrder(parser.value(orderOption).toStdString(), options.shapeOrder)) {
+            std::cout << "invalid --shape-order" << std::endl;
+            return 1;
+        }
+        return runBenchmark(options);
+    }
+
     MainWindow w;
     w.show();
 
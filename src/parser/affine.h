@@ -0,0 +1,95 @@
+#pragma once
+
+#include "scenedata.h"
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Affine transforms stored as a glm::mat4x3: the three columns of the linear
+// part followed by the translation, with the implicit bottom row (0, 0, 0, 1)
+// left out. They compose like glm::mat4, in a quarter less space and with
+// fewer multiplies.
+
+inline glm::mat4x3 affineIdentity() {
+    return glm::mat4x3(1.f);
+}
+
+// a * b, as for the equivalent 4x4 matrices
+inline glm::mat4x3 affineMultiply(const glm::mat4x3 &a, const glm::mat4x3 &b) {
+    glm::mat3 linear(a);
+    return glm::mat4x3(linear * b[0], linear * b[1], linear * b[2], linear * b[3] + a[3]);
+}
+
+// m * translate(v), as glm::translate does for a mat4
+inline glm::mat4x3 affineTranslate(const glm::mat4x3 &m, const glm::vec3 &v) {
+    glm::mat4x3 result = m;
+    result[3] = m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3];
+    return result;
+}
+
+// m * scale(v), as glm::scale does for a mat4
+inline glm::mat4x3 affineScale(const glm::mat4x3 &m, const glm::vec3 &v) {
+    return glm::mat4x3(m[0] * v.x, m[1] * v.y, m[2] * v.z, m[3]);
+}
+
+// m * rotate(angle, axis), as glm::rotate does for a mat4
+inline glm::mat4x3 affineRotate(const glm::mat4x3 &m, float angle, const glm::vec3 &axis) {
+    float c = glm::cos(angle);
+    float s = glm::sin(angle);
+    glm::vec3 a = glm::normalize(axis);
+    glm::vec3 t = (1.f - c) * a;
+
+    glm::mat3 rotate;
+    rotate[0] = glm::vec3(c + t.x * a.x, t.x * a.y + s * a.z, t.x * a.z - s * a.y);
+    rotate[1] = glm::vec3(t.y * a.x - s * a.z, c + t.y * a.y, t.y * a.z + s * a.x);
+    rotate[2] = glm::vec3(t.z * a.x + s * a.y, t.z * a.y - s * a.x, c + t.z * a.z);
+
+    glm::mat3 linear(m);
+    return glm::mat4x3(linear * rotate[0], linear * rotate[1], linear * rotate[2], m[3]);
+}
+
+// Whether the bottom row of m is (0, 0, 0, 1), so it loses nothing as a mat4x3
+inline bool isAffine(const glm::mat4 &m) {
+    return m[0][3] == 0.f && m[1][3] == 0.f && m[2][3] == 0.f && m[3][3] == 1.f;
+}
+
+// The top three rows of m
+inline glm::mat4x3 affineFromMat4(const glm::mat4 &m) {
+    return glm::mat4x3(m);
+}
+
+inline glm::mat4 affineToMat4(const glm::mat4x3 &m) {
+    return glm::mat4(glm::vec4(m[0], 0.f), glm::vec4(m[1], 0.f), glm::vec4(m[2], 0.f), glm::vec4(m[3], 1.f));
+}
+
+inline glm::vec3 transformPoint(const glm::mat4x3 &m, const glm::vec3 &p) {
+    return m[0] * p.x + m[1] * p.y + m[2] * p.z + m[3];
+}
+
+inline glm::vec3 transformVector(const glm::mat4x3 &m, const glm::vec3 &v) {
+    return m[0] * v.x + m[1] * v.y + m[2] * v.z;
+}
+
+// The transformations applied in order, as a single matrix. Custom matrices
+// must be affine, as only their top three rows are used.
+inline glm::mat4x3 composeTransformations(const std::vector<SceneTransformation *> &transformations) {
+    glm::mat4x3 local = affineIdentity();
+    for (const SceneTransformation *transformation : transformations) {
+        switch (transformation->type) {
+        case TransformationType::TRANSFORMATION_TRANSLATE:
+            local = affineTranslate(local, transformation->translate);
+            break;
+        case TransformationType::TRANSFORMATION_SCALE:
+            local = affineScale(local, transformation->scale);
+            break;
+        case TransformationType::TRANSFORMATION_ROTATE:
+            local = affineRotate(local, transformation->angle, transformation->rotate);
+            break;
+        case TransformationType::TRANSFORMATION_MATRIX:
+            local = affineMultiply(local, affineFromMat4(transformation->matrix));
+            break;
+        }
+    }
+    return local;
+}
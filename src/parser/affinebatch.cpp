@@ -0,0 +1,120 @@
+#include "affinebatch.h"
+
+#if (defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))) || \
+    (defined(_MSC_VER) && defined(_M_X64))
+#define AFFINE_BATCH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(AFFINE_BATCH_X86) && defined(__GNUC__)
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#else
+#define AVX2_TARGET
+#endif
+
+// The kernels address vectors as 4 consecutive floats
+static_assert(sizeof(glm::vec4) == 4 * sizeof(float));
+
+namespace {
+
+// Narrower batches are not worth the indirect call into a kernel
+constexpr size_t MinBatchWidth = 4;
+
+void transformScalar(const glm::mat4x3 &m, const glm::vec4 *in, glm::vec4 *out, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = glm::vec4(m * in[i], in[i].w);
+    }
+}
+
+#ifdef AFFINE_BATCH_X86
+
+void transformSse(const glm::mat4x3 &m, const glm::vec4 *in, glm::vec4 *out, size_t count) {
+    // The last column carries w through to the result
+    __m128 c0 = _mm_setr_ps(m[0].x, m[0].y, m[0].z, 0.f);
+    __m128 c1 = _mm_setr_ps(m[1].x, m[1].y, m[1].z, 0.f);
+    __m128 c2 = _mm_setr_ps(m[2].x, m[2].y, m[2].z, 0.f);
+    __m128 c3 = _mm_setr_ps(m[3].x, m[3].y, m[3].z, 1.f);
+    for (size_t i = 0; i < count; i++) {
+        __m128 v = _mm_loadu_ps(&in[i].x);
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))),
+                                         _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)))),
+                              _mm_add_ps(_mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))),
+                                         _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)))));
+        _mm_storeu_ps(&out[i].x, r);
+    }
+}
+
+AVX2_TARGET void transformAvx2(const glm::mat4x3 &m, const glm::vec4 *in, glm::vec4 *out, size_t count) {
+    // Two vectors per iteration, one in each 128-bit half
+    __m256 c0 = _mm256_setr_ps(m[0].x, m[0].y, m[0].z, 0.f, m[0].x, m[0].y, m[0].z, 0.f);
+    __m256 c1 = _mm256_setr_ps(m[1].x, m[1].y, m[1].z, 0.f, m[1].x, m[1].y, m[1].z, 0.f);
+    __m256 c2 = _mm256_setr_ps(m[2].x, m[2].y, m[2].z, 0.f, m[2].x, m[2].y, m[2].z, 0.f);
+    __m256 c3 = _mm256_setr_ps(m[3].x, m[3].y, m[3].z, 1.f, m[3].x, m[3].y, m[3].z, 1.f);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m256 v = _mm256_loadu_ps(&in[i].x);
+        __m256 r = _mm256_fmadd_ps(c3, _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)),
+                                   _mm256_fmadd_ps(c2, _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2)),
+                                                   _mm256_fmadd_ps(c1, _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1)),
+                                                                   _mm256_mul_ps(c0, _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0))))));
+        _mm256_storeu_ps(&out[i].x, r);
+    }
+    if (i < count) {
+        transformSse(m, in + i, out + i, count - i);
+    }
+}
+
+bool supportsAvx2() {
+#if defined(__GNUC__)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+    int info[4];
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // The OS must save the AVX registers on context switches
+    if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#endif
+}
+
+#endif // AFFINE_BATCH_X86
+
+struct Kernels {
+    void (*transform)(const glm::mat4x3 &, const glm::vec4 *, glm::vec4 *, size_t);
+    const char *instructionSet;
+};
+
+const Kernels &kernels() {
+    static const Kernels selected = [] {
+#ifdef AFFINE_BATCH_X86
+        if (supportsAvx2()) {
+            return Kernels{transformAvx2, "avx2"};
+        }
+        return Kernels{transformSse, "sse"};
+#else
+        return Kernels{transformScalar, "scalar"};
+#endif
+    }();
+    return selected;
+}
+
+} // namespace
+
+void affineTransformBatch(const glm::mat4x3 &m, const glm::vec4 *in, glm::vec4 *out, size_t count) {
+    if (count < MinBatchWidth) {
+        transformScalar(m, in, out, count);
+        return;
+    }
+    kernels().transform(m, in, out, count);
+}
+
+const char *affineBatchInstructionSet() {
+    return kernels().instructionSet;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "affine.h"
+
+#include <cstddef>
+
+// A batched form of transforming vectors by an affine matrix, used by
+// ScenePager to bound the unit cube of each node it measures. It is
+// vectorized with AVX2 and FMA or with SSE, whichever the CPU supports,
+// chosen once at run time; other CPUs, and batches of fewer than four, use
+// the scalar loop.
+
+// out[i] = (m * in[i], in[i].w), so points with w = 1 are moved and
+// directions with w = 0 are only rotated and scaled. out may be in.
+void affineTransformBatch(const glm::mat4x3 &m, const glm::vec4 *in, glm::vec4 *out, size_t count);
+
+// The instruction set affineTransformBatch uses: "avx2", "sse" or "scalar".
+const char *affineBatchInstructionSet();
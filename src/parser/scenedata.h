@@ -166,4 +166,9 @@ struct SceneNode {
     std::vector<ScenePrimitive*> primitives;
     std::vector<SceneLight*> lights;
     std::vector<SceneNode*> children;
+
+    // The transformations composed into one affine matrix, if the reader baked
+    // them, which it does not for projective custom matrices
+    bool hasLocalMatrix = false;
+    glm::mat4x3 localMatrix = glm::mat4x3(1.f);
 };
@@ -0,0 +1,181 @@
+#include "scenedecompressor.h"
+
+#include <algorithm>
+#include <memory>
+
+#include <QFile>
+
+#ifdef SCENE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SCENE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// Sizes of the compressed reads and of the room made for each decompression step
+constexpr qint64 InputChunkSize = 256 * 1024;
+constexpr qsizetype OutputChunkSize = 1024 * 1024;
+
+// Makes OutputChunkSize bytes of room at the end of contents and returns
+// where it starts. The capacity at least doubles, so growing is amortized.
+char *growOutput(QByteArray &contents) {
+    qsizetype size = contents.size();
+    if (contents.capacity() < size + OutputChunkSize) {
+        contents.reserve(std::max(size + OutputChunkSize, 2 * contents.capacity()));
+    }
+    contents.resize(size + OutputChunkSize);
+    return contents.data() + size;
+}
+
+bool inflateGzip(QFile &file, QByteArray &contents, std::string &error) {
+#ifdef SCENE_ZLIB
+    z_stream stream = {};
+    // 32 lets zlib detect the gzip header
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        error = "could not initialize zlib";
+        return false;
+    }
+    std::unique_ptr<z_stream, int (*)(z_stream *)> cleanup(&stream, inflateEnd);
+
+    QByteArray input;
+    bool streamEnded = false;
+    bool outputFull = false;
+    while (true) {
+        // A full output chunk may leave output pending without more input
+        if (stream.avail_in == 0 && !outputFull) {
+            input = file.read(InputChunkSize);
+            if (input.isEmpty()) {
+                break;
+            }
+            stream.next_in = (Bytef *)input.data();
+            stream.avail_in = (uInt)input.size();
+        }
+
+        if (streamEnded) {
+            // Zero padding may follow the last member, as gzip itself accepts
+            while (stream.avail_in > 0 && *stream.next_in == 0) {
+                stream.next_in++;
+                stream.avail_in--;
+            }
+            if (stream.avail_in == 0) {
+                continue;
+            }
+            // Concatenated gzip members decompress to the concatenation
+            inflateReset(&stream);
+            streamEnded = false;
+        }
+
+        stream.next_out = (Bytef *)growOutput(contents);
+        stream.avail_out = (uInt)OutputChunkSize;
+        int status = inflate(&stream, Z_NO_FLUSH);
+        contents.chop(stream.avail_out);
+        if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+            error = std::string("corrupt gzip data: ") + (stream.msg ? stream.msg : "unknown error");
+            return false;
+        }
+
+        // Nothing is pending after the end of a member, even if it filled the chunk exactly
+        streamEnded = status == Z_STREAM_END;
+        outputFull = !streamEnded && stream.avail_out == 0;
+    }
+
+    if (!streamEnded) {
+        error = "truncated gzip data";
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(file);
+    Q_UNUSED(contents);
+    error = "this build does not support gzip-compressed scenes";
+    return false;
+#endif
+}
+
+bool inflateZstd(QFile &file, QByteArray &contents, std::string &error) {
+#ifdef SCENE_ZSTD
+    std::unique_ptr<ZSTD_DStream, size_t (*)(ZSTD_DStream *)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+    ZSTD_initDStream(stream.get());
+
+    size_t status = 0;
+    while (true) {
+        QByteArray input = file.read(InputChunkSize);
+        if (input.isEmpty()) {
+            break;
+        }
+
+        ZSTD_inBuffer in = {input.constData(), (size_t)input.size(), 0};
+        bool outputFull = false;
+        while (in.pos < in.size || outputFull) {
+            ZSTD_outBuffer out = {growOutput(contents), (size_t)OutputChunkSize, 0};
+            status = ZSTD_decompressStream(stream.get(), &out, &in);
+            contents.chop((qsizetype)(out.size - out.pos));
+            if (ZSTD_isError(status)) {
+                error = std::string("corrupt zstd data: ") + ZSTD_getErrorName(status);
+                return false;
+            }
+
+            outputFull = out.pos == out.size;
+        }
+    }
+
+    // A non-zero hint means the last frame is incomplete
+    if (status != 0) {
+        error = "truncated zstd data";
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(file);
+    Q_UNUSED(contents);
+    error = "this build does not support zstd-compressed scenes";
+    return false;
+#endif
+}
+
+} // namespace
+
+SceneCompression detectCompression(const QByteArray &head) {
+    if (head.startsWith("\x1f\x8b")) {
+        return SceneCompression::COMPRESSION_GZIP;
+    }
+    if (head.startsWith("\x28\xb5\x2f\xfd")) {
+        return SceneCompression::COMPRESSION_ZSTD;
+    }
+    return SceneCompression::COMPRESSION_NONE;
+}
+
+bool readSceneFile(const std::string &path, QByteArray &contents, std::string &error) {
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QFile::ReadOnly)) {
+        error = "could not open " + path;
+        return false;
+    }
+
+    SceneCompression compression = detectCompression(file.peek(4));
+    if (compression == SceneCompression::COMPRESSION_NONE) {
+        contents = file.readAll();
+        return true;
+    }
+
+    contents.clear();
+    std::string decompressError;
+    bool decompressed = compression == SceneCompression::COMPRESSION_GZIP ? inflateGzip(file, contents, decompressError)
+                                                                          : inflateZstd(file, contents, decompressError);
+    if (!decompressed) {
+        error = decompressError + " in " + path;
+        return false;
+    }
+    return true;
+}
+
+std::string withoutCompressionSuffix(const std::string &path) {
+    for (std::string_view suffix : {".gz", ".zst"}) {
+        if (path.ends_with(suffix)) {
+            return path.substr(0, path.size() - suffix.size());
+        }
+    }
+    return path;
+}
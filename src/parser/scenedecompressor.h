@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include <QByteArray>
+
+enum class SceneCompression {
+    COMPRESSION_NONE,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+// Recognises gzip and zstd streams by their magic bytes.
+SceneCompression detectCompression(const QByteArray &head);
+
+// Reads a scene file into contents, decompressing gzip or zstd input as it
+// is read, straight into the end of contents. Uncompressed files are read as
+// they are. On failure error says why.
+bool readSceneFile(const std::string &path, QByteArray &contents, std::string &error);
+
+// The path without a trailing .gz or .zst.
+std::string withoutCompressionSuffix(const std::string &path);
@@ -0,0 +1,197 @@
+#include "scenededup.h"
+#include "scenediff.h"
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "glm/gtc/type_ptr.hpp"
+
+namespace {
+
+void hashFloats(size_t &h, const float *values, int count) {
+    for (int i = 0; i < count; i++) {
+        h = h * 31 + std::hash<float>()(values[i]);
+    }
+}
+
+template <typename T>
+void hashValue(size_t &h, const T &value) {
+    h = h * 31 + std::hash<T>()(value);
+}
+
+void hashMaterial(size_t &h, const SceneMaterial &material) {
+    for (const SceneColor *color : {&material.cAmbient, &material.cDiffuse, &material.cSpecular, &material.cReflective,
+                                    &material.cTransparent, &material.cEmissive}) {
+        hashFloats(h, glm::value_ptr(*color), 4);
+    }
+    hashValue(h, material.shininess);
+    hashValue(h, material.ior);
+    hashValue(h, material.blend);
+    for (const SceneFileMap *map : {&material.textureMap, &material.bumpMap}) {
+        hashValue(h, map->isUsed);
+        if (map->isUsed) {
+            hashValue(h, map->filename);
+            hashValue(h, map->repeatU);
+            hashValue(h, map->repeatV);
+        }
+    }
+}
+
+// Children are hashed by address, as they are merged before their parents
+size_t hashNode(const SceneNode *node) {
+    size_t h = 0;
+    for (const SceneTransformation *transformation : node->transformations) {
+        hashValue(h, (int)transformation->type);
+        switch (transformation->type) {
+        case TransformationType::TRANSFORMATION_TRANSLATE:
+            hashFloats(h, glm::value_ptr(transformation->translate), 3);
+            break;
+        case TransformationType::TRANSFORMATION_SCALE:
+            hashFloats(h, glm::value_ptr(transformation->scale), 3);
+            break;
+        case TransformationType::TRANSFORMATION_ROTATE:
+            hashFloats(h, glm::value_ptr(transformation->rotate), 3);
+            hashValue(h, transformation->angle);
+            break;
+        case TransformationType::TRANSFORMATION_MATRIX:
+            hashFloats(h, glm::value_ptr(transformation->matrix), 16);
+            break;
+        }
+    }
+    for (const ScenePrimitive *primitive : node->primitives) {
+        hashValue(h, (int)primitive->type);
+        hashValue(h, primitive->meshfile);
+        hashMaterial(h, primitive->material);
+    }
+    for (const SceneLight *light : node->lights) {
+        hashValue(h, (int)light->type);
+        hashFloats(h, glm::value_ptr(light->color), 4);
+        hashFloats(h, glm::value_ptr(light->function), 3);
+        hashFloats(h, glm::value_ptr(light->dir), 4);
+        hashValue(h, light->angle);
+        hashValue(h, light->penumbra);
+    }
+    for (const SceneNode *child : node->children) {
+        hashValue(h, child);
+    }
+    // Node lists of different lengths must not run into each other
+    hashValue(h, node->transformations.size());
+    hashValue(h, node->primitives.size());
+    hashValue(h, node->lights.size());
+    return h;
+}
+
+bool sameTransformation(const SceneTransformation &a, const SceneTransformation &b) {
+    if (a.type != b.type) {
+        return false;
+    }
+    switch (a.type) {
+    case TransformationType::TRANSFORMATION_TRANSLATE:
+        return a.translate == b.translate;
+    case TransformationType::TRANSFORMATION_SCALE:
+        return a.scale == b.scale;
+    case TransformationType::TRANSFORMATION_ROTATE:
+        return a.rotate == b.rotate && a.angle == b.angle;
+    case TransformationType::TRANSFORMATION_MATRIX:
+        return a.matrix == b.matrix;
+    }
+    return false;
+}
+
+bool samePrimitive(const ScenePrimitive &a, const ScenePrimitive &b) {
+    return a.type == b.type && a.meshfile == b.meshfile && sameMaterial(a.material, b.material);
+}
+
+bool sameLight(const SceneLight &a, const SceneLight &b) {
+    return a.id == b.id && a.type == b.type && a.color == b.color && a.function == b.function && a.dir == b.dir &&
+           a.penumbra == b.penumbra && a.angle == b.angle && a.width == b.width && a.height == b.height;
+}
+
+template <typename T, typename Same>
+bool sameItems(const std::vector<T *> &a, const std::vector<T *> &b, Same same) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [&](const T *x, const T *y) { return same(*x, *y); });
+}
+
+bool sameNode(const SceneNode *a, const SceneNode *b) {
+    return a->children == b->children && sameItems(a->transformations, b->transformations, sameTransformation) &&
+           sameItems(a->primitives, b->primitives, samePrimitive) && sameItems(a->lights, b->lights, sameLight);
+}
+
+class SubtreeMerger {
+public:
+    SceneNode *merge(SceneNode *node) {
+        if (m_stats.cyclic) {
+            return node;
+        }
+        auto [it, inserted] = m_merged.emplace(node, nullptr);
+        if (!inserted) {
+            // Still null while the node's own children are being merged
+            if (it->second == nullptr) {
+                m_stats.cyclic = true;
+                return node;
+            }
+            m_stats.mergedSubtrees += it->second != node ? 1 : 0;
+            return it->second;
+        }
+        m_stats.nodes++;
+
+        for (SceneNode *&child : node->children) {
+            child = merge(child);
+        }
+
+        SceneNode *merged = node;
+        size_t h = hashNode(node);
+        auto [first, last] = m_nodes.equal_range(h);
+        for (auto candidate = first; candidate != last; ++candidate) {
+            if (sameNode(candidate->second, node)) {
+                merged = candidate->second;
+                break;
+            }
+        }
+        if (merged == node) {
+            m_nodes.emplace(h, node);
+        }
+        else {
+            m_stats.mergedSubtrees++;
+        }
+
+        // The map may have been rehashed by the children
+        m_merged[node] = merged;
+        return merged;
+    }
+
+    SubtreeDedupStats stats() const { return m_stats; }
+
+private:
+    std::unordered_map<SceneNode *, SceneNode *> m_merged;
+    std::unordered_multimap<size_t, SceneNode *> m_nodes;
+    SubtreeDedupStats m_stats;
+};
+
+} // namespace
+
+SubtreeDedupStats deduplicateSubtrees(const std::vector<SceneNode **> &roots, std::unordered_set<SceneNode *> &reachable) {
+    SubtreeMerger merger;
+    std::vector<SceneNode *> stack;
+    for (SceneNode **root : roots) {
+        *root = merger.merge(*root);
+        stack.push_back(*root);
+    }
+
+    reachable.clear();
+    if (merger.stats().cyclic) {
+        return merger.stats();
+    }
+    while (!stack.empty()) {
+        SceneNode *node = stack.back();
+        stack.pop_back();
+        if (reachable.insert(node).second) {
+            stack.insert(stack.end(), node->children.begin(), node->children.end());
+        }
+    }
+
+    SubtreeDedupStats stats = merger.stats();
+    stats.mergedNodes = stats.nodes - reachable.size();
+    return stats;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "scenedata.h"
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+// How much of a scene graph deduplicateSubtrees merged.
+struct SubtreeDedupStats {
+    size_t nodes = 0;          // Distinct nodes reachable before merging
+    size_t mergedSubtrees = 0; // References redirected to an identical subtree
+    size_t mergedNodes = 0;    // Distinct nodes no longer reachable after merging
+    bool cyclic = false;       // A node is among its own descendants
+};
+
+// Merges every subtree which is identical to one met earlier, in its
+// transformations, primitives, materials, lights and children, into that one,
+// so both are shared like references to a template group. Subtrees are
+// compared bottom up by a structural hash, visiting roots and children in
+// order, so the first occurrence in the file is the one kept. Each root is
+// replaced by its merged node. On return reachable holds the nodes still
+// reachable from the roots; the merged away ones are left for the caller to
+// free. If a node turns out to contain itself, merging stops and the stats
+// are marked cyclic, leaving reachable empty and nothing to free.
+SubtreeDedupStats deduplicateSubtrees(const std::vector<SceneNode **> &roots, std::unordered_set<SceneNode *> &reachable);
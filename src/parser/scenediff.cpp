@@ -0,0 +1,83 @@
+#include "scenediff.h"
+
+#include <algorithm>
+
+namespace {
+
+bool sameFileMap(const SceneFileMap &a, const SceneFileMap &b) {
+    if (a.isUsed != b.isUsed) {
+        return false;
+    }
+    return !a.isUsed || (a.filename == b.filename && a.repeatU == b.repeatU && a.repeatV == b.repeatV);
+}
+
+bool sameGlobal(const SceneGlobalData &a, const SceneGlobalData &b) {
+    return a.ka == b.ka && a.kd == b.kd && a.ks == b.ks && a.kt == b.kt;
+}
+
+bool sameCamera(const SceneCameraData &a, const SceneCameraData &b) {
+    return a.pos == b.pos && a.look == b.look && a.up == b.up && a.heightAngle == b.heightAngle &&
+           a.aperture == b.aperture && a.focalLength == b.focalLength;
+}
+
+bool sameShape(const RenderShapeData &a, const RenderShapeData &b) {
+    return a.primitive.type == b.primitive.type && a.ctm == b.ctm && a.primitive.meshfile == b.primitive.meshfile &&
+           sameMaterial(a.primitive.material, b.primitive.material);
+}
+
+bool sameLight(const SceneLightData &a, const SceneLightData &b) {
+    return a.id == b.id && a.type == b.type && a.color == b.color && a.function == b.function && a.pos == b.pos &&
+           a.dir == b.dir && a.penumbra == b.penumbra && a.angle == b.angle && a.width == b.width &&
+           a.height == b.height;
+}
+
+} // namespace
+
+bool sameMaterial(const SceneMaterial &a, const SceneMaterial &b) {
+    return a.cAmbient == b.cAmbient && a.cDiffuse == b.cDiffuse && a.cSpecular == b.cSpecular &&
+           a.shininess == b.shininess && a.cReflective == b.cReflective && a.cTransparent == b.cTransparent &&
+           a.ior == b.ior && sameFileMap(a.textureMap, b.textureMap) && a.blend == b.blend &&
+           a.cEmissive == b.cEmissive && sameFileMap(a.bumpMap, b.bumpMap);
+}
+
+bool SceneDiff::empty() const {
+    return !globalChanged && !cameraChanged && !lightsChanged && !shapeCountChanged && changedShapes.empty();
+}
+
+SceneDiff diffScenes(const RenderData &before, const RenderData &after) {
+    SceneDiff diff;
+    diff.globalChanged = !sameGlobal(before.globalData, after.globalData);
+    diff.cameraChanged = !sameCamera(before.cameraData, after.cameraData);
+    diff.lightsChanged = !std::equal(before.lights.begin(), before.lights.end(), after.lights.begin(),
+                                     after.lights.end(), sameLight);
+
+    const std::vector<RenderShapeData> &oldShapes = before.shapes;
+    const std::vector<RenderShapeData> &newShapes = after.shapes;
+    if (oldShapes.size() == newShapes.size()) {
+        for (size_t i = 0; i < newShapes.size(); i++) {
+            if (!sameShape(oldShapes[i], newShapes[i])) {
+                diff.changedShapes.push_back(i);
+            }
+        }
+        return diff;
+    }
+
+    // An edit in one place of the file adds or removes a run of shapes, so
+    // everything before and after that run is kept
+    size_t common = std::min(oldShapes.size(), newShapes.size());
+    size_t prefix = 0;
+    while (prefix < common && sameShape(oldShapes[prefix], newShapes[prefix])) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < common - prefix &&
+           sameShape(oldShapes[oldShapes.size() - 1 - suffix], newShapes[newShapes.size() - 1 - suffix])) {
+        suffix++;
+    }
+
+    diff.shapeCountChanged = true;
+    diff.firstShape = prefix;
+    diff.oldShapesEnd = oldShapes.size() - suffix;
+    diff.newShapesEnd = newShapes.size() - suffix;
+    return diff;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "sceneparser.h"
+
+#include <cstddef>
+#include <vector>
+
+// What differs between two versions of a scene. Shapes are matched by
+// position: when both have as many shapes, changedShapes lists the indices of
+// those whose primitive or transform differs. Otherwise the shapes from
+// firstShape up to oldShapesEnd of the old scene are replaced by those up to
+// newShapesEnd of the new one, with the unchanged shapes on either side kept.
+struct SceneDiff {
+    bool globalChanged = false;
+    bool cameraChanged = false;
+    bool lightsChanged = false;
+
+    bool shapeCountChanged = false;
+    std::vector<size_t> changedShapes;
+    size_t firstShape = 0;
+    size_t oldShapesEnd = 0;
+    size_t newShapesEnd = 0;
+
+    bool empty() const;
+};
+
+SceneDiff diffScenes(const RenderData &before, const RenderData &after);
+
+// Whether two materials are the same in every field. Texture maps which are
+// not used are equal whatever their other fields.
+bool sameMaterial(const SceneMaterial &a, const SceneMaterial &b);
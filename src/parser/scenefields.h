@@ -0,0 +1,290 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+#include <QJsonObject>
+#include <QtGlobal>
+
+#include "scenedata.h"
+
+// The fields a scene file object may contain, as a perfect hash table built
+// at compile time. Field is an enum listing the fields in the same order as
+// the names passed to the constructor.
+template <typename Field, size_t N>
+class FieldTable {
+public:
+    using FieldType = Field;
+    static constexpr size_t FieldCount = N;
+
+    consteval FieldTable(const std::string_view (&names)[N], std::initializer_list<Field> required) {
+        for (size_t i = 0; i < N; i++) {
+            m_names[i] = names[i];
+        }
+        for (Field field : required) {
+            m_required[(size_t)field] = true;
+        }
+
+        // Try seeds until every name lands in a slot of its own
+        for (m_seed = 0; !placeAll(); m_seed++) {
+        }
+    }
+
+    // Returns the field named by the key, or -1 if it is not one of the table's.
+    template <typename Char>
+    constexpr int find(const Char *key, size_t length) const {
+        int field = m_slots[slotOf(key, length)];
+        if (field < 0 || m_names[field].size() != length) {
+            return -1;
+        }
+        for (size_t i = 0; i < length; i++) {
+            if (code(key[i]) != code(m_names[field][i])) {
+                return -1;
+            }
+        }
+        return field;
+    }
+
+    constexpr int find(std::string_view key) const { return find(key.data(), key.size()); }
+
+    constexpr std::string_view name(Field field) const { return m_names[(size_t)field]; }
+    constexpr bool isRequired(Field field) const { return m_required[(size_t)field]; }
+
+private:
+    // A power of two with at least twice as many slots as names
+    static constexpr size_t TableSize = [] {
+        size_t size = 1;
+        while (size < 2 * N) {
+            size <<= 1;
+        }
+        return size;
+    }();
+
+    static constexpr uint32_t code(char c) { return (unsigned char)c; }
+    static constexpr uint32_t code(char16_t c) { return c; }
+    static constexpr uint32_t code(uint16_t c) { return c; }
+
+    template <typename Char>
+    constexpr size_t slotOf(const Char *key, size_t length) const {
+        // FNV-1a over the character codes, so Latin-1, UTF-8 and UTF-16 keys hash alike
+        uint32_t h = 2166136261u ^ m_seed;
+        for (size_t i = 0; i < length; i++) {
+            h = (h ^ code(key[i])) * 16777619u;
+        }
+        return (h ^ (h >> 15)) & (TableSize - 1);
+    }
+
+    constexpr bool placeAll() {
+        m_slots.fill(-1);
+        for (size_t i = 0; i < N; i++) {
+            size_t slot = slotOf(m_names[i].data(), m_names[i].size());
+            if (m_slots[slot] >= 0) {
+                return false;
+            }
+            m_slots[slot] = (int8_t)i;
+        }
+        return true;
+    }
+
+    std::array<std::string_view, N> m_names{};
+    std::array<bool, N> m_required{};
+    std::array<int8_t, TableSize> m_slots{};
+    uint32_t m_seed = 0;
+};
+
+enum class RootField {
+    ROOT_GLOBAL_DATA,
+    ROOT_CAMERA_DATA,
+    ROOT_NAME,
+    ROOT_GROUPS,
+    ROOT_TEMPLATE_GROUPS
+};
+
+inline constexpr FieldTable<RootField, 5> RootFields(
+    {"globalData", "cameraData", "name", "groups", "templateGroups"},
+    {RootField::ROOT_GLOBAL_DATA, RootField::ROOT_CAMERA_DATA});
+
+// Scene files included by another only contribute their groups
+inline constexpr FieldTable<RootField, 5> IncludedRootFields(
+    {"globalData", "cameraData", "name", "groups", "templateGroups"},
+    {});
+
+enum class GlobalField {
+    GLOBAL_AMBIENT_COEFF,
+    GLOBAL_DIFFUSE_COEFF,
+    GLOBAL_SPECULAR_COEFF,
+    GLOBAL_TRANSPARENT_COEFF
+};
+
+inline constexpr FieldTable<GlobalField, 4> GlobalFields(
+    {"ambientCoeff", "diffuseCoeff", "specularCoeff", "transparentCoeff"},
+    {GlobalField::GLOBAL_AMBIENT_COEFF, GlobalField::GLOBAL_DIFFUSE_COEFF, GlobalField::GLOBAL_SPECULAR_COEFF});
+
+enum class CameraField {
+    CAMERA_POSITION,
+    CAMERA_UP,
+    CAMERA_HEIGHT_ANGLE,
+    CAMERA_APERTURE,
+    CAMERA_FOCAL_LENGTH,
+    CAMERA_LOOK,
+    CAMERA_FOCUS
+};
+
+inline constexpr FieldTable<CameraField, 7> CameraFields(
+    {"position", "up", "heightAngle", "aperture", "focalLength", "look", "focus"},
+    {CameraField::CAMERA_POSITION, CameraField::CAMERA_UP, CameraField::CAMERA_HEIGHT_ANGLE});
+
+enum class LightField {
+    LIGHT_TYPE,
+    LIGHT_COLOR,
+    LIGHT_NAME,
+    LIGHT_ATTENUATION_COEFF,
+    LIGHT_DIRECTION,
+    LIGHT_PENUMBRA,
+    LIGHT_ANGLE
+};
+
+inline constexpr FieldTable<LightField, 7> LightFields(
+    {"type", "color", "name", "attenuationCoeff", "direction", "penumbra", "angle"},
+    {LightField::LIGHT_TYPE, LightField::LIGHT_COLOR});
+
+// Groups and template groups share their fields; only templates require a name
+enum class GroupField {
+    GROUP_NAME,
+    GROUP_TRANSLATE,
+    GROUP_ROTATE,
+    GROUP_SCALE,
+    GROUP_MATRIX,
+    GROUP_LIGHTS,
+    GROUP_PRIMITIVES,
+    GROUP_GROUPS,
+    GROUP_INCLUDE
+};
+
+inline constexpr FieldTable<GroupField, 9> GroupFields(
+    {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups", "include"},
+    {});
+
+inline constexpr FieldTable<GroupField, 9> TemplateGroupFields(
+    {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups", "include"},
+    {GroupField::GROUP_NAME});
+
+enum class PrimitiveField {
+    PRIMITIVE_TYPE,
+    PRIMITIVE_MESH_FILE,
+    PRIMITIVE_AMBIENT,
+    PRIMITIVE_DIFFUSE,
+    PRIMITIVE_SPECULAR,
+    PRIMITIVE_REFLECTIVE,
+    PRIMITIVE_TRANSPARENT,
+    PRIMITIVE_SHININESS,
+    PRIMITIVE_IOR,
+    PRIMITIVE_BLEND,
+    PRIMITIVE_TEXTURE_FILE,
+    PRIMITIVE_TEXTURE_U,
+    PRIMITIVE_TEXTURE_V,
+    PRIMITIVE_BUMP_MAP_FILE,
+    PRIMITIVE_BUMP_MAP_U,
+    PRIMITIVE_BUMP_MAP_V
+};
+
+inline constexpr FieldTable<PrimitiveField, 16> PrimitiveFields(
+    {"type", "meshFile", "ambient", "diffuse", "specular", "reflective", "transparent", "shininess", "ior",
+     "blend", "textureFile", "textureU", "textureV", "bumpMapFile", "bumpMapU", "bumpMapV"},
+    {PrimitiveField::PRIMITIVE_TYPE});
+
+// The fields a light of each type requires besides type and color, and the
+// name that type goes by in error messages
+struct LightRequirements {
+    const char *name;
+    std::span<const LightField> fields;
+};
+
+inline LightRequirements lightRequirements(LightType type) {
+    static constexpr LightField pointFields[] = {LightField::LIGHT_ATTENUATION_COEFF};
+    static constexpr LightField directionalFields[] = {LightField::LIGHT_DIRECTION};
+    static constexpr LightField spotFields[] = {LightField::LIGHT_DIRECTION, LightField::LIGHT_PENUMBRA,
+                                                LightField::LIGHT_ANGLE, LightField::LIGHT_ATTENUATION_COEFF};
+    switch (type) {
+    case LightType::LIGHT_DIRECTIONAL:
+        return {"directional light", directionalFields};
+    case LightType::LIGHT_SPOT:
+        return {"spotlight", spotFields};
+    default:
+        return {"point light", pointFields};
+    }
+}
+
+// Keywords of string-valued fields, in the order of the enums in scenedata.h
+inline constexpr FieldTable<LightType, 3> LightTypeNames({"point", "directional", "spot"}, {});
+
+inline constexpr FieldTable<PrimitiveType, 5> PrimitiveTypeNames({"cube", "cone", "cylinder", "sphere", "mesh"}, {});
+
+// The fields of one JSON object, collected in a single pass over its keys
+// without converting them to QStrings. Table is one of the tables above.
+template <const auto &Table>
+class ObjectFields {
+public:
+    using Field = typename std::remove_cvref_t<decltype(Table)>::FieldType;
+
+    // Collects the fields of object, reporting unknown keys and missing
+    // required fields against objectName. Returns false if there are any.
+    bool read(const QJsonObject &object, const char *objectName);
+
+    bool has(Field field) const { return m_values[(size_t)field] != m_end; }
+
+    // The value of a field; the field must be present.
+    auto value(Field field) const { return m_values[(size_t)field].value(); }
+
+private:
+    static int find(const QJsonObject::const_iterator &it);
+
+    std::array<QJsonObject::const_iterator, std::remove_cvref_t<decltype(Table)>::FieldCount> m_values;
+    QJsonObject::const_iterator m_end;
+};
+
+template <const auto &Table>
+bool ObjectFields<Table>::read(const QJsonObject &object, const char *objectName) {
+    m_end = object.constEnd();
+    m_values.fill(m_end);
+
+    for (auto it = object.constBegin(); it != m_end; ++it) {
+        int field = find(it);
+        if (field < 0) {
+            std::cout << "unknown field \"" << it.key().toStdString() << "\" on " << objectName << " object" << std::endl;
+            return false;
+        }
+        m_values[field] = it;
+    }
+
+    for (size_t i = 0; i < m_values.size(); i++) {
+        if (Table.isRequired((Field)i) && m_values[i] == m_end) {
+            std::cout << "missing required field \"" << Table.name((Field)i) << "\" on " << objectName << " object" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template <const auto &Table>
+int ObjectFields<Table>::find(const QJsonObject::const_iterator &it) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 4, 0)
+    return it.keyView().visit([](auto key) {
+        if constexpr (std::is_same_v<decltype(key), QStringView>) {
+            return Table.find(key.utf16(), (size_t)key.size());
+        }
+        else {
+            return Table.find(key.data(), (size_t)key.size());
+        }
+    });
+#else
+    QString key = it.key();
+    return Table.find(key.utf16(), (size_t)key.size());
+#endif
+}
@@ -1,15 +1,28 @@
 #include "scenefilereader.h"
+#include "affine.h"
 #include "scenedata.h"
+#include "scenedecompressor.h"
+#include "scenefields.h"
 
 #include "glm/gtc/type_ptr.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 #include <filesystem>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
+#include <QCborMap>
+#include <QCborValue>
 #include <QFile>
 #include <QJsonArray>
+#include <QMutex>
+#include <QThread>
+#include <QThreadPool>
 
 #define ERROR_AT(e) "error at line " << e.lineNumber() << " col " << e.columnNumber() << ": "
 #define PARSE_ERROR(e) std::cout << ERROR_AT(e) << "could not parse <" << e.tagName().toStdString() \
@@ -18,7 +31,53 @@
                                          << e.tagName().toStdString() << ">" << std::endl;
 
 // Students, please ignore this file.
-ScenefileReader::ScenefileReader(const std::string &name) {
+// Every scene file taking part in one read, by canonical path. Each included
+// file is parsed once, by a reader of its own on the pool.
+struct ScenefileReader::IncludeCache {
+    QMutex mutex;
+    std::map<std::string, ScenefileReader *> readers;
+    std::map<ScenefileReader *, std::vector<ScenefileReader *>> includes;
+    std::vector<std::unique_ptr<ScenefileReader>> owned;
+    QThreadPool pool;
+};
+
+namespace {
+
+std::string canonicalPath(const std::filesystem::path &path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path.string() : canonical.string();
+}
+
+// "include" only appears as a group field, so any object holding one is a group
+void collectIncludes(const QJsonValue &value, std::vector<std::string> &includes) {
+    if (value.isArray()) {
+        for (const QJsonValue &item : value.toArray()) {
+            collectIncludes(item, includes);
+        }
+    }
+    else if (value.isObject()) {
+        const QJsonObject object = value.toObject();
+        for (auto it = object.begin(); it != object.end(); ++it) {
+            if (it.key() == QLatin1String("include") && it.value().isString()) {
+                includes.push_back(it.value().toString().toStdString());
+            }
+            else {
+                collectIncludes(it.value(), includes);
+            }
+        }
+    }
+}
+
+} // namespace
+
+ScenefileReader::ScenefileReader(const std::string &name) : ScenefileReader(name, nullptr) {
+    m_ownedIncludes = std::make_unique<IncludeCache>();
+    m_includes = m_ownedIncludes.get();
+    m_includes->readers[canonicalPath(name)] = this;
+}
+
+ScenefileReader::ScenefileReader(const std::string &name, IncludeCache *includes) : m_includes(includes) {
     file_name = name;
 
     memset(&m_cameraData, 0, sizeof(SceneCameraData));
@@ -34,23 +93,48 @@ ScenefileReader::ScenefileReader(const std::string &name) {
 
 ScenefileReader::~ScenefileReader() {
     // Delete all Scene Nodes
-    for (unsigned int node = 0; node < m_nodes.size(); node++) {
-        for (size_t i = 0; i < (m_nodes[node])->transformations.size(); i++)
+    deleteNodes(m_nodes);
+    m_templates.clear();
+}
+
+void ScenefileReader::deleteNodes(std::vector<SceneNode *> &nodes) {
+    for (unsigned int node = 0; node < nodes.size(); node++) {
+        for (size_t i = 0; i < (nodes[node])->transformations.size(); i++)
         {
-            delete (m_nodes[node])->transformations[i];
+            delete (nodes[node])->transformations[i];
         }
-        for (size_t i = 0; i < (m_nodes[node])->primitives.size(); i++)
+        for (size_t i = 0; i < (nodes[node])->primitives.size(); i++)
         {
-            delete (m_nodes[node])->primitives[i];
+            delete (nodes[node])->primitives[i];
         }
-        (m_nodes[node])->transformations.clear();
-        (m_nodes[node])->primitives.clear();
-        (m_nodes[node])->children.clear();
-        delete m_nodes[node];
+        for (size_t i = 0; i < (nodes[node])->lights.size(); i++)
+        {
+            delete (nodes[node])->lights[i];
+        }
+        (nodes[node])->transformations.clear();
+        (nodes[node])->primitives.clear();
+        (nodes[node])->lights.clear();
+        (nodes[node])->children.clear();
+        delete nodes[node];
     }
 
-    m_nodes.clear();
-    m_templates.clear();
+    nodes.clear();
+}
+
+void ScenefileReader::setParallelGroups(bool parallel) {
+    m_parallelGroups = parallel;
+}
+
+void ScenefileReader::setDeduplicateSubtrees(bool deduplicate) {
+    m_deduplicateSubtrees = deduplicate;
+}
+
+void ScenefileReader::setBakeLocalMatrices(bool bake) {
+    m_bakeLocalMatrices = bake;
+}
+
+SubtreeDedupStats ScenefileReader::getDedupStats() const {
+    return m_dedupStats;
 }
 
 SceneGlobalData ScenefileReader::getGlobalData() const {
@@ -65,451 +149,510 @@ SceneNode *ScenefileReader::getRootNode() const {
     return m_root;
 }
 
-// This is where it all goes down...
-bool ScenefileReader::readJSON() {
-    // Read the file
-    QFile file(file_name.c_str());
-    if (!file.open(QFile::ReadOnly)) {
-        std::cout << "could not open " << file_name << std::endl;
-        return false;
-    }
+bool ScenefileReader::isCborScene(const QByteArray &contents) const {
+    // The self-describe tag which CBOR scenes start with, or else the extension
+    return contents.startsWith("\xd9\xd9\xf7") || withoutCompressionSuffix(file_name).ends_with(".cbor");
+}
 
-    // Load the JSON document
-    QByteArray fileContents = file.readAll();
+bool ScenefileReader::loadJson(const QByteArray &contents, QJsonObject &scenefile) const {
     QJsonParseError jsonError;
-    QJsonDocument doc = QJsonDocument::fromJson(fileContents, &jsonError);
+    QJsonDocument doc = QJsonDocument::fromJson(contents, &jsonError);
     if (doc.isNull()) {
         std::cout << "could not parse " << file_name << std::endl;
         std::cout << "parse error at line " << jsonError.offset << ": "
                   << jsonError.errorString().toStdString() << std::endl;
         return false;
     }
-    file.close();
 
     if (!doc.isObject()) {
         std::cout << "document is not an object" << std::endl;
         return false;
     }
+    scenefile = doc.object();
+    return true;
+}
 
-    // Get the root element
-    QJsonObject scenefile = doc.object();
+bool ScenefileReader::loadCbor(const QByteArray &contents, QJsonObject &scenefile) const {
+    QCborParserError cborError;
+    QCborValue value = QCborValue::fromCbor(contents, &cborError);
+    if (cborError.error != QCborError::NoError) {
+        std::cout << "could not parse " << file_name << std::endl;
+        std::cout << "parse error at byte " << cborError.offset << ": "
+                  << cborError.errorString().toStdString() << std::endl;
+        return false;
+    }
+    if (value.isTag()) {
+        value = value.taggedValue();
+    }
 
-    if (!scenefile.contains("globalData")) {
-        std::cout << "missing required field \"globalData\" on root object" << std::endl;
+    if (!value.isMap()) {
+        std::cout << "document is not a map" << std::endl;
         return false;
     }
-    if (!scenefile.contains("cameraData")) {
-        std::cout << "missing required field \"cameraData\" on root object" << std::endl;
+    // QCborMap and QJsonObject share their storage format, so this converts
+    // the values directly rather than through text
+    scenefile = value.toMap().toJsonObject();
+    return true;
+}
+
+// This is where it all goes down...
+bool ScenefileReader::readJSON() {
+    bool success = parseSceneFile();
+
+    // Included files are loaded while this one is parsed; wait for them
+    // even on failure, as they are still being parsed into the cache
+    if (!finishIncludes() || !success) {
         return false;
     }
+    return deduplicateNodes();
+}
 
-    QStringList requiredFields = {"globalData", "cameraData"};
-    QStringList optionalFields = {"name", "groups", "templateGroups"};
-    // If other fields are present, raise an error
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto &field : scenefile.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on root object" << std::endl;
-            return false;
+void ScenefileReader::listIncludedFiles(const std::string &path, std::vector<std::string> &files) {
+    std::set<std::string> visited = {canonicalPath(path)};
+    std::vector<std::string> pending = {path};
+    while (!pending.empty()) {
+        ScenefileReader reader(pending.back());
+        pending.pop_back();
+
+        QByteArray contents;
+        std::string error;
+        QJsonObject scenefile;
+        if (!readSceneFile(reader.file_name, contents, error) ||
+            !(reader.isCborScene(contents) ? reader.loadCbor(contents, scenefile) : reader.loadJson(contents, scenefile))) {
+            continue;
+        }
+
+        std::vector<std::string> includes;
+        collectIncludes(scenefile, includes);
+        for (const std::string &include : includes) {
+            // Relative to the including file, as in includeScene
+            std::filesystem::path includePath = std::filesystem::path(reader.file_name).parent_path() / include;
+            if (visited.insert(canonicalPath(includePath)).second) {
+                files.push_back(includePath.string());
+                pending.push_back(includePath.string());
+            }
         }
     }
+}
 
-    // Parse the global data
-    if (!parseGlobalData(scenefile["globalData"].toObject())) {
-        std::cout << "could not parse \"globalData\"" << std::endl;
-        return false;
+SceneNode *ScenefileReader::includeScene(const std::string &path) {
+    std::filesystem::path includePath = std::filesystem::path(file_name).parent_path() / path;
+
+    QMutexLocker locker(&m_includes->mutex);
+    ScenefileReader *&reader = m_includes->readers[canonicalPath(includePath)];
+    if (!reader) {
+        m_includes->owned.push_back(std::unique_ptr<ScenefileReader>(new ScenefileReader(includePath.string(), m_includes)));
+        reader = m_includes->owned.back().get();
+        // Included files are read with this reader's settings
+        reader->m_parallelGroups = m_parallelGroups;
+        reader->m_deduplicateSubtrees = m_deduplicateSubtrees;
+        reader->m_bakeLocalMatrices = m_bakeLocalMatrices;
+
+        ScenefileReader *included = reader;
+        m_includes->pool.start([included] { included->m_failed = !included->parseSceneFile(); });
+    }
+    // Groups parsed once the read is finished are not part of the graph it checked
+    if (m_recordIncludes) {
+        m_includes->includes[this].push_back(reader);
     }
+    return reader->m_root;
+}
 
-    // Parse the camera data
-    if (!parseCameraData(scenefile["cameraData"].toObject())) {
-        std::cout << "could not parse \"cameraData\"" << std::endl;
+bool ScenefileReader::finishIncludes() {
+    m_includes->pool.waitForDone();
+    m_recordIncludes = false;
+
+    std::map<ScenefileReader *, int> state;
+    return checkIncludes(this, state);
+}
+
+bool ScenefileReader::checkIncludes(ScenefileReader *reader, std::map<ScenefileReader *, int> &state) const {
+    if (reader->m_failed) {
         return false;
     }
 
-    // Parse the template groups
-    if (scenefile.contains("templateGroups")) {
-        if (!parseTemplateGroups(scenefile["templateGroups"])) {
-            return false;
-        }
+    // Files may share an included file, but must not include themselves, even indirectly
+    int &readerState = state[reader]; // 1 while being visited, 2 once done
+    if (readerState == 1) {
+        std::cout << "scene file " << reader->file_name << " includes itself" << std::endl;
+        return false;
     }
-
-    // Parse the groups
-    if (scenefile.contains("groups")) {
-        if (!parseGroups(scenefile["groups"], m_root)) {
+    if (readerState == 2) {
+        return true;
+    }
+    readerState = 1;
+    for (ScenefileReader *included : m_includes->includes[reader]) {
+        if (!checkIncludes(included, state)) {
             return false;
         }
     }
-
-    std::cout << "Finished reading " << file_name << std::endl;
+    readerState = 2;
     return true;
 }
 
-/**
- * Parse a globalData field and fill in m_globalData.
- */
-bool ScenefileReader::parseGlobalData(const QJsonObject &globalData) {
-    QStringList requiredFields = {"ambientCoeff", "diffuseCoeff", "specularCoeff"};
-    QStringList optionalFields = {"transparentCoeff"};
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto field : globalData.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on globalData object" << std::endl;
-            return false;
-        }
+bool ScenefileReader::readContents(const QByteArray &contents) {
+    bool success = parseSceneContents(contents);
+    if (!finishIncludes() || !success) {
+        return false;
     }
-    for (auto field : requiredFields) {
-        if (!globalData.contains(field)) {
-            std::cout << "missing required field \"" << field.toStdString() << "\" on globalData object" << std::endl;
-            return false;
-        }
+    return deduplicateNodes();
+}
+
+bool ScenefileReader::deduplicateNodes() {
+    if (!m_deduplicateSubtrees) {
+        return true;
     }
 
-    // Parse the global data
-    if (globalData["ambientCoeff"].isDouble()) {
-        m_globalData.ka = globalData["ambientCoeff"].toDouble();
+    // The roots of included files and the template groups stay valid, as
+    // groups parsed later, such as detached ones, may still refer to them
+    std::vector<ScenefileReader *> readers = {this};
+    for (const std::unique_ptr<ScenefileReader> &included : m_includes->owned) {
+        readers.push_back(included.get());
     }
-    else {
-        std::cout << "globalData ambientCoeff must be a floating-point value" << std::endl;
-        return false;
+    std::vector<SceneNode **> roots;
+    for (ScenefileReader *reader : readers) {
+        roots.push_back(&reader->m_root);
     }
-    if (globalData["diffuseCoeff"].isDouble()) {
-        m_globalData.kd = globalData["diffuseCoeff"].toDouble();
+    for (auto &[name, node] : m_templates) {
+        roots.push_back(&node);
     }
-    else {
-        std::cout << "globalData diffuseCoeff must be a floating-point value" << std::endl;
+    std::unordered_set<SceneNode *> reachable;
+    m_dedupStats = deduplicateSubtrees(roots, reachable);
+    if (m_dedupStats.cyclic) {
+        // Nothing was freed, so the reader still owns every node
+        std::cout << "template groups cannot reference themselves" << std::endl;
         return false;
     }
-    if (globalData["specularCoeff"].isDouble()) {
-        m_globalData.ks = globalData["specularCoeff"].toDouble();
+    if (m_dedupStats.mergedSubtrees == 0) {
+        return true;
     }
-    else {
-        std::cout << "globalData specularCoeff must be a floating-point value" << std::endl;
-        return false;
-    }
-    if (globalData.contains("transparentCoeff")) {
-        if (globalData["transparentCoeff"].isDouble()) {
-            m_globalData.kt = globalData["transparentCoeff"].toDouble();
-        }
-        else {
-            std::cout << "globalData transparentCoeff must be a floating-point value" << std::endl;
-            return false;
-        }
+
+    // Free the nodes merged away, from whichever file's reader allocated them
+    for (ScenefileReader *reader : readers) {
+        auto unreachable = std::partition(reader->m_nodes.begin(), reader->m_nodes.end(),
+                                          [&](SceneNode *node) { return reachable.count(node) != 0; });
+        std::vector<SceneNode *> merged(unreachable, reader->m_nodes.end());
+        reader->m_nodes.erase(unreachable, reader->m_nodes.end());
+        deleteNodes(merged);
     }
 
+    std::cout << "Merged " << m_dedupStats.mergedSubtrees << " duplicate subtrees of " << file_name << ", freeing "
+              << m_dedupStats.mergedNodes << " of " << m_dedupStats.nodes << " nodes" << std::endl;
     return true;
 }
 
-/**
- * Parse a Light and add a new CS123SceneLightData to m_lights.
- */
-bool ScenefileReader::parseLightData(const QJsonObject &lightData, SceneNode *node) {
-    QStringList requiredFields = {"type", "color"};
-    QStringList optionalFields = {"name", "attenuationCoeff", "direction", "penumbra", "angle"};
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto &field : lightData.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on light object" << std::endl;
-            return false;
-        }
-    }
-    for (auto &field : requiredFields) {
-        if (!lightData.contains(field)) {
-            std::cout << "missing required field \"" << field.toStdString() << "\" on light object" << std::endl;
-            return false;
-        }
+SceneNode *ScenefileReader::parseDetachedGroup(const QByteArray &json, std::vector<SceneNode *> &nodes) {
+    QJsonParseError jsonError;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &jsonError);
+    if (!doc.isObject()) {
+        std::cout << "could not parse group of " << file_name << ": " << jsonError.errorString().toStdString() << std::endl;
+        return nullptr;
     }
 
-    // Create a default light
-    SceneLight *light = new SceneLight();
-    memset(light, 0, sizeof(SceneLight));
-    node->lights.push_back(light);
-
-    light->dir = glm::vec4(0.f, 0.f, 0.f, 0.f);
-    light->function = glm::vec3(1, 0, 0);
+    // Parsed as a one-element groups array, so a reference to a template
+    // group resolves to the template just as it does in the whole file
+    std::vector<SceneNode *> children;
+    bool success = parseGroupRange(QJsonArray{doc.object()}, 0, 1, children, nodes);
 
-    // parse the color
-    if (!lightData["color"].isArray()) {
-        std::cout << "light color must be of type array" << std::endl;
-        return false;
+    // The group may have included files which are still being parsed
+    m_includes->pool.waitForDone();
+    if (!success || children.empty()) {
+        return nullptr;
     }
-    QJsonArray colorArray = lightData["color"].toArray();
-    if (colorArray.size() != 3) {
-        std::cout << "light color must be of size 3" << std::endl;
-        return false;
+
+    // Only the files this group includes decide whether it loaded, not
+    // those of groups parsed before it
+    std::vector<std::string> includes;
+    collectIncludes(doc.object(), includes);
+    QMutexLocker locker(&m_includes->mutex);
+    std::map<ScenefileReader *, int> state;
+    for (const std::string &include : includes) {
+        auto reader = m_includes->readers.find(canonicalPath(std::filesystem::path(file_name).parent_path() / include));
+        if (reader != m_includes->readers.end() && !checkIncludes(reader->second, state)) {
+            return nullptr;
+        }
     }
-    if (!colorArray[0].isDouble() || !colorArray[1].isDouble() || !colorArray[2].isDouble()) {
-        std::cout << "light color must contain floating-point values" << std::endl;
+    return children.front();
+}
+
+bool ScenefileReader::parseSceneFile() {
+    // Read the file, decompressing it if needed
+    QByteArray fileContents;
+    std::string error;
+    if (!readSceneFile(file_name, fileContents, error)) {
+        std::cout << error << std::endl;
         return false;
     }
-    light->color.r = colorArray[0].toDouble();
-    light->color.g = colorArray[1].toDouble();
-    light->color.b = colorArray[2].toDouble();
+    return parseSceneContents(fileContents);
+}
 
-    // parse the type
-    if (!lightData["type"].isString()) {
-        std::cout << "light type must be of type string" << std::endl;
+bool ScenefileReader::parseSceneContents(const QByteArray &fileContents) {
+    // Get the root element
+    QJsonObject scenefile;
+    if (!(isCborScene(fileContents) ? loadCbor(fileContents, scenefile) : loadJson(fileContents, scenefile))) {
         return false;
     }
-    std::string lightType = lightData["type"].toString().toStdString();
 
-    // parse directional light
-    if (lightType == "directional") {
-        light->type = LightType::LIGHT_DIRECTIONAL;
+    // File paths in the scene are relative to the directory above the scene file's
+    m_basepath = std::filesystem::path(file_name).parent_path().parent_path();
 
-        // parse direction
-        if (!lightData.contains("direction")) {
-            std::cout << "directional light must contain field \"direction\"" << std::endl;
+    // Included files only need groups
+    auto parseRoot = [&](auto &fields) {
+        if (!fields.read(scenefile, "root")) {
             return false;
         }
-        if (!lightData["direction"].isArray()) {
-            std::cout << "directional light direction must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray directionArray = lightData["direction"].toArray();
-        if (directionArray.size() != 3) {
-            std::cout << "directional light direction must be of size 3" << std::endl;
-            return false;
-        }
-        if (!directionArray[0].isDouble() || !directionArray[1].isDouble() || !directionArray[2].isDouble()) {
-            std::cout << "directional light direction must contain floating-point values" << std::endl;
-            return false;
-        }
-        light->dir.x = directionArray[0].toDouble();
-        light->dir.y = directionArray[1].toDouble();
-        light->dir.z = directionArray[2].toDouble();
-    }
-    else if (lightType == "point") {
-        light->type = LightType::LIGHT_POINT;
 
-        // parse the attenuation coefficient
-        if (!lightData.contains("attenuationCoeff")) {
-            std::cout << "point light must contain field \"attenuationCoeff\"" << std::endl;
-            return false;
-        }
-        if (!lightData["attenuationCoeff"].isArray()) {
-            std::cout << "point light attenuationCoeff must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray attenuationArray = lightData["attenuationCoeff"].toArray();
-        if (attenuationArray.size() != 3) {
-            std::cout << "point light attenuationCoeff must be of size 3" << std::endl;
-            return false;
-        }
-        if (!attenuationArray[0].isDouble() || !attenuationArray[1].isDouble() || !attenuationArray[2].isDouble()) {
-            std::cout << "ppoint light attenuationCoeff must contain floating-point values" << std::endl;
-            return false;
-        }
-        light->function.x = attenuationArray[0].toDouble();
-        light->function.y = attenuationArray[1].toDouble();
-        light->function.z = attenuationArray[2].toDouble();
-    }
-    else if (lightType == "spot") {
-        QStringList pointRequiredFields = {"direction", "penumbra", "angle", "attenuationCoeff"};
-        for (auto &field : pointRequiredFields) {
-            if (!lightData.contains(field)) {
-                std::cout << "missing required field \"" << field.toStdString() << "\" on spotlight object" << std::endl;
+        // Parse the global data
+        if (fields.has(RootField::ROOT_GLOBAL_DATA)) {
+            if (!parseGlobalData(fields.value(RootField::ROOT_GLOBAL_DATA).toObject())) {
+                std::cout << "could not parse \"globalData\"" << std::endl;
                 return false;
             }
         }
-        light->type = LightType::LIGHT_SPOT;
 
-        // parse direction
-        if (!lightData["direction"].isArray()) {
-            std::cout << "spotlight direction must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray directionArray = lightData["direction"].toArray();
-        if (directionArray.size() != 3) {
-            std::cout << "spotlight direction must be of size 3" << std::endl;
-            return false;
+        // Parse the camera data
+        if (fields.has(RootField::ROOT_CAMERA_DATA)) {
+            if (!parseCameraData(fields.value(RootField::ROOT_CAMERA_DATA).toObject())) {
+                std::cout << "could not parse \"cameraData\"" << std::endl;
+                return false;
+            }
         }
-        if (!directionArray[0].isDouble() || !directionArray[1].isDouble() || !directionArray[2].isDouble()) {
-            std::cout << "spotlight direction must contain floating-point values" << std::endl;
-            return false;
+
+        // Parse the template groups
+        if (fields.has(RootField::ROOT_TEMPLATE_GROUPS)) {
+            if (!parseTemplateGroups(fields.value(RootField::ROOT_TEMPLATE_GROUPS))) {
+                return false;
+            }
         }
-        light->dir.x = directionArray[0].toDouble();
-        light->dir.y = directionArray[1].toDouble();
-        light->dir.z = directionArray[2].toDouble();
 
-        // parse attenuation coefficient
-        if (!lightData["attenuationCoeff"].isArray()) {
-            std::cout << "spotlight attenuationCoeff must be of type array" << std::endl;
-            return false;
+        // Parse the groups
+        if (fields.has(RootField::ROOT_GROUPS)) {
+            if (!parseRootGroups(fields.value(RootField::ROOT_GROUPS))) {
+                return false;
+            }
         }
-        QJsonArray attenuationArray = lightData["attenuationCoeff"].toArray();
-        if (attenuationArray.size() != 3) {
-            std::cout << "spotlight attenuationCoeff must be of size 3" << std::endl;
+        return true;
+    };
+
+    if (m_ownedIncludes) {
+        ObjectFields<RootFields> fields;
+        if (!parseRoot(fields)) {
             return false;
         }
-        if (!attenuationArray[0].isDouble() || !attenuationArray[1].isDouble() || !attenuationArray[2].isDouble()) {
-            std::cout << "spotlight direction must contain floating-point values" << std::endl;
+    }
+    else {
+        ObjectFields<IncludedRootFields> fields;
+        if (!parseRoot(fields)) {
             return false;
         }
-        light->function.x = attenuationArray[0].toDouble();
-        light->function.y = attenuationArray[1].toDouble();
-        light->function.z = attenuationArray[2].toDouble();
+    }
 
-        // parse penumbra
-        if (!lightData["penumbra"].isDouble()) {
-            std::cout << "spotlight penumbra must be of type float" << std::endl;
-            return false;
-        }
-        light->penumbra = lightData["penumbra"].toDouble() * M_PI / 180.f;
+    std::cout << "Finished reading " << file_name << std::endl;
+    return true;
+}
 
-        // parse angle
-        if (!lightData["angle"].isDouble()) {
-            std::cout << "spotlight angle must be of type float" << std::endl;
+namespace {
+
+// Reads an array of count numbers into out, e.g. the rgb of a SceneColor.
+// what names the value in error messages.
+bool readFloats(const QJsonValue &value, const char *what, int count, float *out) {
+    if (!value.isArray()) {
+        std::cout << what << " must be of type array" << std::endl;
+        return false;
+    }
+    // A const array, so element access never detaches it from the document
+    const QJsonArray array = value.toArray();
+    if (array.size() != count) {
+        std::cout << what << " must have " << count << " elements" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        QJsonValue element = array.at(i);
+        if (!element.isDouble()) {
+            std::cout << what << " must contain floating-point values" << std::endl;
             return false;
         }
-        light->angle = lightData["angle"].toDouble() * M_PI / 180.f;
+        out[i] = (float)element.toDouble();
     }
-    else {
-        std::cout << "unknown light type \"" << lightType << "\"" << std::endl;
+    return true;
+}
+
+bool readFloat(const QJsonValue &value, const char *what, float &out) {
+    if (!value.isDouble()) {
+        std::cout << what << " must be a floating-point value" << std::endl;
         return false;
     }
+    out = (float)value.toDouble();
+    return true;
+}
 
+// Reads a path relative to the scene directory.
+bool readPath(const QJsonValue &value, const char *what, const std::filesystem::path &basepath, std::string &out) {
+    if (!value.isString()) {
+        std::cout << what << " must be of type string" << std::endl;
+        return false;
+    }
+    out = (basepath / std::filesystem::path(value.toString().toStdString())).string();
     return true;
 }
 
+// Looks up a string value in a keyword table. Returns -1 if it is not a string or not a keyword.
+template <typename Keyword, size_t N>
+int readKeyword(const QJsonValue &value, const FieldTable<Keyword, N> &keywords) {
+    if (!value.isString()) {
+        return -1;
+    }
+    QString string = value.toString();
+    return keywords.find(string.utf16(), (size_t)string.size());
+}
+
+} // namespace
+
 /**
- * Parse cameraData and fill in m_cameraData.
+ * Parse a globalData field and fill in m_globalData.
  */
-bool ScenefileReader::parseCameraData(const QJsonObject &cameradata) {
-    QStringList requiredFields = {"position", "up", "heightAngle"};
-    QStringList optionalFields = {"aperture", "focalLength", "look", "focus"};
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto &field : cameradata.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on cameraData object" << std::endl;
-            return false;
-        }
+bool ScenefileReader::parseGlobalData(const QJsonObject &globalData) {
+    ObjectFields<GlobalFields> fields;
+    if (!fields.read(globalData, "globalData")) {
+        return false;
     }
-    for (auto &field : requiredFields) {
-        if (!cameradata.contains(field)) {
-            std::cout << "missing required field \"" << field.toStdString() << "\" on cameraData object" << std::endl;
+
+    // Parse the global data
+    if (!readFloat(fields.value(GlobalField::GLOBAL_AMBIENT_COEFF), "globalData ambientCoeff", m_globalData.ka) ||
+        !readFloat(fields.value(GlobalField::GLOBAL_DIFFUSE_COEFF), "globalData diffuseCoeff", m_globalData.kd) ||
+        !readFloat(fields.value(GlobalField::GLOBAL_SPECULAR_COEFF), "globalData specularCoeff", m_globalData.ks)) {
+        return false;
+    }
+    if (fields.has(GlobalField::GLOBAL_TRANSPARENT_COEFF)) {
+        if (!readFloat(fields.value(GlobalField::GLOBAL_TRANSPARENT_COEFF), "globalData transparentCoeff", m_globalData.kt)) {
             return false;
         }
     }
 
-    // Must have either look or focus, but not both
-    if (cameradata.contains("look") && cameradata.contains("focus")) {
-        std::cout << "cameraData cannot contain both \"look\" and \"focus\"" << std::endl;
+    return true;
+}
+
+/**
+ * Parse a Light and add a new CS123SceneLightData to m_lights.
+ */
+bool ScenefileReader::parseLightData(const QJsonObject &lightData, SceneNode *node) {
+    ObjectFields<LightFields> fields;
+    if (!fields.read(lightData, "light")) {
         return false;
     }
 
-    // Parse the camera data
-    if (cameradata["position"].isArray()) {
-        QJsonArray position = cameradata["position"].toArray();
-        if (position.size() != 3) {
-            std::cout << "cameraData position must have 3 elements" << std::endl;
+    // Create a default light
+    SceneLight *light = new SceneLight();
+    memset(light, 0, sizeof(SceneLight));
+    node->lights.push_back(light);
+
+    light->dir = glm::vec4(0.f, 0.f, 0.f, 0.f);
+    light->function = glm::vec3(1, 0, 0);
+
+    // parse the color
+    if (!readFloats(fields.value(LightField::LIGHT_COLOR), "light color", 3, glm::value_ptr(light->color))) {
+        return false;
+    }
+
+    // parse the type
+    if (!fields.value(LightField::LIGHT_TYPE).isString()) {
+        std::cout << "light type must be of type string" << std::endl;
+        return false;
+    }
+    int lightType = readKeyword(fields.value(LightField::LIGHT_TYPE), LightTypeNames);
+    if (lightType < 0) {
+        std::cout << "unknown light type \"" << fields.value(LightField::LIGHT_TYPE).toString().toStdString() << "\"" << std::endl;
+        return false;
+    }
+    light->type = (LightType)lightType;
+
+    // Fields each type of light requires
+    LightRequirements requirements = lightRequirements(light->type);
+    const char *lightName = requirements.name;
+    for (LightField field : requirements.fields) {
+        if (!fields.has(field)) {
+            std::cout << lightName << " must contain field \"" << LightFields.name(field) << "\"" << std::endl;
             return false;
         }
-        if (!position[0].isDouble() || !position[1].isDouble() || !position[2].isDouble()) {
-            std::cout << "cameraData position must be a floating-point value" << std::endl;
+    }
+
+    if (light->type == LightType::LIGHT_DIRECTIONAL || light->type == LightType::LIGHT_SPOT) {
+        std::string what = std::string(lightName) + " direction";
+        if (!readFloats(fields.value(LightField::LIGHT_DIRECTION), what.c_str(), 3, glm::value_ptr(light->dir))) {
             return false;
         }
-        m_cameraData.pos.x = position[0].toDouble();
-        m_cameraData.pos.y = position[1].toDouble();
-        m_cameraData.pos.z = position[2].toDouble();
-    }
-    else {
-        std::cout << "cameraData position must be an array" << std::endl;
-        return false;
     }
-
-    if (cameradata["up"].isArray()) {
-        QJsonArray up = cameradata["up"].toArray();
-        if (up.size() != 3) {
-            std::cout << "cameraData up must have 3 elements" << std::endl;
+    if (light->type == LightType::LIGHT_POINT || light->type == LightType::LIGHT_SPOT) {
+        std::string what = std::string(lightName) + " attenuationCoeff";
+        if (!readFloats(fields.value(LightField::LIGHT_ATTENUATION_COEFF), what.c_str(), 3, glm::value_ptr(light->function))) {
             return false;
         }
-        if (!up[0].isDouble() || !up[1].isDouble() || !up[2].isDouble()) {
-            std::cout << "cameraData up must be a floating-point value" << std::endl;
+    }
+    if (light->type == LightType::LIGHT_SPOT) {
+        if (!readFloat(fields.value(LightField::LIGHT_PENUMBRA), "spotlight penumbra", light->penumbra) ||
+            !readFloat(fields.value(LightField::LIGHT_ANGLE), "spotlight angle", light->angle)) {
             return false;
         }
-        m_cameraData.up.x = up[0].toDouble();
-        m_cameraData.up.y = up[1].toDouble();
-        m_cameraData.up.z = up[2].toDouble();
+        light->penumbra *= M_PI / 180.f;
+        light->angle *= M_PI / 180.f;
     }
-    else {
-        std::cout << "cameraData up must be an array" << std::endl;
+
+    return true;
+}
+
+/**
+ * Parse cameraData and fill in m_cameraData.
+ */
+bool ScenefileReader::parseCameraData(const QJsonObject &cameradata) {
+    ObjectFields<CameraFields> fields;
+    if (!fields.read(cameradata, "cameraData")) {
         return false;
     }
 
-    if (cameradata["heightAngle"].isDouble()) {
-        m_cameraData.heightAngle = cameradata["heightAngle"].toDouble() * M_PI / 180.f;
+    // Must have either look or focus, but not both
+    bool hasLook = fields.has(CameraField::CAMERA_LOOK);
+    bool hasFocus = fields.has(CameraField::CAMERA_FOCUS);
+    if (hasLook && hasFocus) {
+        std::cout << "cameraData cannot contain both \"look\" and \"focus\"" << std::endl;
+        return false;
     }
-    else {
-        std::cout << "cameraData heightAngle must be a floating-point value" << std::endl;
+
+    // Parse the camera data
+    if (!readFloats(fields.value(CameraField::CAMERA_POSITION), "cameraData position", 3, glm::value_ptr(m_cameraData.pos)) ||
+        !readFloats(fields.value(CameraField::CAMERA_UP), "cameraData up", 3, glm::value_ptr(m_cameraData.up)) ||
+        !readFloat(fields.value(CameraField::CAMERA_HEIGHT_ANGLE), "cameraData heightAngle", m_cameraData.heightAngle)) {
         return false;
     }
+    m_cameraData.heightAngle *= M_PI / 180.f;
 
-    if (cameradata.contains("aperture")) {
-        if (cameradata["aperture"].isDouble()) {
-            m_cameraData.aperture = cameradata["aperture"].toDouble();
-        }
-        else {
-            std::cout << "cameraData aperture must be a floating-point value" << std::endl;
+    if (fields.has(CameraField::CAMERA_APERTURE)) {
+        if (!readFloat(fields.value(CameraField::CAMERA_APERTURE), "cameraData aperture", m_cameraData.aperture)) {
             return false;
         }
     }
 
-    if (cameradata.contains("focalLength")) {
-        if (cameradata["focalLength"].isDouble()) {
-            m_cameraData.focalLength = cameradata["focalLength"].toDouble();
-        }
-        else {
-            std::cout << "cameraData focalLength must be a floating-point value" << std::endl;
+    if (fields.has(CameraField::CAMERA_FOCAL_LENGTH)) {
+        if (!readFloat(fields.value(CameraField::CAMERA_FOCAL_LENGTH), "cameraData focalLength", m_cameraData.focalLength)) {
             return false;
         }
     }
 
     // Parse the look or focus
     // if the focus is specified, we will convert it to a look vector later
-    if (cameradata.contains("look")) {
-        if (cameradata["look"].isArray()) {
-            QJsonArray look = cameradata["look"].toArray();
-            if (look.size() != 3) {
-                std::cout << "cameraData look must have 3 elements" << std::endl;
-                return false;
-            }
-            if (!look[0].isDouble() || !look[1].isDouble() || !look[2].isDouble()) {
-                std::cout << "cameraData look must be a floating-point value" << std::endl;
-                return false;
-            }
-            m_cameraData.look.x = look[0].toDouble();
-            m_cameraData.look.y = look[1].toDouble();
-            m_cameraData.look.z = look[2].toDouble();
-        }
-        else {
-            std::cout << "cameraData look must be an array" << std::endl;
+    if (hasLook) {
+        if (!readFloats(fields.value(CameraField::CAMERA_LOOK), "cameraData look", 3, glm::value_ptr(m_cameraData.look))) {
             return false;
         }
     }
-    else if (cameradata.contains("focus")) {
-        if (cameradata["focus"].isArray()) {
-            QJsonArray focus = cameradata["focus"].toArray();
-            if (focus.size() != 3) {
-                std::cout << "cameraData focus must have 3 elements" << std::endl;
-                return false;
-            }
-            if (!focus[0].isDouble() || !focus[1].isDouble() || !focus[2].isDouble()) {
-                std::cout << "cameraData focus must be a floating-point value" << std::endl;
-                return false;
-            }
-            m_cameraData.look.x = focus[0].toDouble();
-            m_cameraData.look.y = focus[1].toDouble();
-            m_cameraData.look.z = focus[2].toDouble();
-        }
-        else {
-            std::cout << "cameraData focus must be an array" << std::endl;
+    else if (hasFocus) {
+        if (!readFloats(fields.value(CameraField::CAMERA_FOCUS), "cameraData focus", 3, glm::value_ptr(m_cameraData.look))) {
             return false;
         }
     }
 
     // Convert the focus point (stored in the look vector) into a
     // look vector from the camera position to that focus point.
-    if (cameradata.contains("focus")) {
+    if (hasFocus) {
         m_cameraData.look -= m_cameraData.pos;
     }
 
@@ -522,154 +665,152 @@ bool ScenefileReader::parseTemplateGroups(const QJsonValue &templateGroups) {
         return false;
     }
 
-    QJsonArray templateGroupsArray = templateGroups.toArray();
-    for (auto templateGroup : templateGroupsArray) {
+    // Register every template name first, so that groups can be parsed in
+    // any order and templates may reference templates defined after them
+    const QJsonArray templateGroupsArray = templateGroups.toArray();
+    std::vector<SceneNode *> templateNodes;
+    templateNodes.reserve(templateGroupsArray.size());
+    for (const QJsonValue &templateGroup : templateGroupsArray) {
         if (!templateGroup.isObject()) {
             std::cout << "templateGroup items must be of type object" << std::endl;
             return false;
         }
 
-        if (!parseTemplateGroupData(templateGroup.toObject())) {
+        const QJsonObject templateData = templateGroup.toObject();
+        auto name = templateData.constFind(QLatin1String("name"));
+        if (name == templateData.constEnd() || !name.value().isString()) {
+            std::cout << "templateGroup name must be a string" << std::endl;
+            return false;
+        }
+
+        SceneNode *templateNode = new SceneNode;
+        m_nodes.push_back(templateNode);
+        templateNodes.push_back(templateNode);
+        std::string templateName = name.value().toString().toStdString();
+        if (!m_templates.emplace(templateName, templateNode).second) {
+            std::cout << "templateGroups cannot have the same name \"" << templateName << "\"" << std::endl;
             return false;
         }
     }
 
-    return true;
+    qsizetype count = templateGroupsArray.size();
+    bool success = parseChunked(count, chunkCount(count), [&](int, qsizetype begin, qsizetype end, std::vector<SceneNode *> &nodes) {
+        for (qsizetype i = begin; i < end; i++) {
+            if (!parseTemplateGroupData(templateGroupsArray.at(i).toObject(), templateNodes[i], nodes)) {
+                return false;
+            }
+        }
+        return true;
+    });
+    return success && checkTemplateCycles(templateNodes);
 }
 
-bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup) {
-    QStringList requiredFields = {"name"};
-    QStringList optionalFields = {"translate", "rotate", "scale", "matrix", "lights", "primitives", "groups"};
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto &field : templateGroup.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on templateGroup object" << std::endl;
-            return false;
+bool ScenefileReader::checkTemplateCycles(const std::vector<SceneNode *> &templateNodes) {
+    // The roots of included files may still be parsing, and only lead to
+    // their own file's templates, so the walk stops at them
+    std::unordered_set<SceneNode *> includedRoots;
+    {
+        QMutexLocker locker(&m_includes->mutex);
+        for (const auto &[path, reader] : m_includes->readers) {
+            if (reader != this) {
+                includedRoots.insert(reader->m_root);
+            }
         }
     }
 
-    for (auto &field : requiredFields) {
-        if (!templateGroup.contains(field)) {
-            std::cout << "missing required field \"" << field.toStdString() << "\" on templateGroup object" << std::endl;
+    std::unordered_map<SceneNode *, int> state; // 1 while being visited, 2 once done
+    std::function<bool(SceneNode *)> visit = [&](SceneNode *node) {
+        int &nodeState = state[node];
+        if (nodeState == 1) {
+            return false;
+        }
+        if (nodeState == 2 || includedRoots.count(node) != 0) {
+            return true;
+        }
+        nodeState = 1;
+        for (SceneNode *child : node->children) {
+            if (!visit(child)) {
+                return false;
+            }
+        }
+        state[node] = 2;
+        return true;
+    };
+    for (SceneNode *templateNode : templateNodes) {
+        if (!visit(templateNode)) {
+            std::cout << "template groups cannot reference themselves" << std::endl;
             return false;
         }
     }
+    return true;
+}
 
-    if (!templateGroup["name"].isString()) {
-        std::cout << "templateGroup name must be a string" << std::endl;
-    }
-    if (m_templates.contains(templateGroup["name"].toString().toStdString())) {
-        std::cout << "templateGroups cannot have the same" << std::endl;
+bool ScenefileReader::parseTemplateGroupData(const QJsonObject &templateGroup, SceneNode *templateNode,
+                                             std::vector<SceneNode *> &nodes) {
+    ObjectFields<TemplateGroupFields> fields;
+    if (!fields.read(templateGroup, "templateGroup")) {
+        return false;
     }
 
-    SceneNode *templateNode = new SceneNode;
-    m_nodes.push_back(templateNode);
-    m_templates[templateGroup["name"].toString().toStdString()] = templateNode;
-
-    return parseGroupData(templateGroup, templateNode);
+    return parseGroupData(templateGroup, templateNode, nodes);
 }
 
 /**
- * Parse a group object and create a new CS123SceneNode in m_nodes.
+ * Parse a group object into node, allocating its child nodes into nodes.
  * NAME OF NODE CANNOT REFERENCE TEMPLATE NODE
  */
-bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node) {
-    QStringList optionalFields = {"name", "translate", "rotate", "scale", "matrix", "lights", "primitives", "groups"};
-    QStringList allFields = optionalFields;
-    for (auto &field : object.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on group object" << std::endl;
-            return false;
-        }
+bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node, std::vector<SceneNode *> &nodes) {
+    ObjectFields<GroupFields> fields;
+    if (!fields.read(object, "group")) {
+        return false;
     }
 
     // parse translation if defined
-    if (object.contains("translate")) {
-        if (!object["translate"].isArray()) {
-            std::cout << "group translate must be of type array" << std::endl;
-            return false;
-        }
-
-        QJsonArray translateArray = object["translate"].toArray();
-        if (translateArray.size() != 3) {
-            std::cout << "group translate must have 3 elements" << std::endl;
-            return false;
-        }
-        if (!translateArray[0].isDouble() || !translateArray[1].isDouble() || !translateArray[2].isDouble()) {
-            std::cout << "group translate must contain floating-point values" << std::endl;
-            return false;
-        }
-
+    if (fields.has(GroupField::GROUP_TRANSLATE)) {
         SceneTransformation *translation = new SceneTransformation();
         translation->type = TransformationType::TRANSFORMATION_TRANSLATE;
-        translation->translate.x = translateArray[0].toDouble();
-        translation->translate.y = translateArray[1].toDouble();
-        translation->translate.z = translateArray[2].toDouble();
-
         node->transformations.push_back(translation);
-    }
 
-    // parse rotation if defined
-    if (object.contains("rotate")) {
-        if (!object["rotate"].isArray()) {
-            std::cout << "group rotate must be of type array" << std::endl;
-            return false;
-        }
-
-        QJsonArray rotateArray = object["rotate"].toArray();
-        if (rotateArray.size() != 4) {
-            std::cout << "group rotate must have 4 elements" << std::endl;
-            return false;
-        }
-        if (!rotateArray[0].isDouble() || !rotateArray[1].isDouble() || !rotateArray[2].isDouble() || !rotateArray[3].isDouble()) {
-            std::cout << "group rotate must contain floating-point values" << std::endl;
+        if (!readFloats(fields.value(GroupField::GROUP_TRANSLATE), "group translate", 3, glm::value_ptr(translation->translate))) {
             return false;
         }
+    }
 
+    // parse rotation if defined
+    if (fields.has(GroupField::GROUP_ROTATE)) {
         SceneTransformation *rotation = new SceneTransformation();
         rotation->type = TransformationType::TRANSFORMATION_ROTATE;
-        rotation->rotate.x = rotateArray[0].toDouble();
-        rotation->rotate.y = rotateArray[1].toDouble();
-        rotation->rotate.z = rotateArray[2].toDouble();
-        rotation->angle = rotateArray[3].toDouble() * M_PI / 180.f;
-
         node->transformations.push_back(rotation);
-    }
 
-    // parse scale if defined
-    if (object.contains("scale")) {
-        if (!object["scale"].isArray()) {
-            std::cout << "group scale must be of type array" << std::endl;
-            return false;
-        }
-
-        QJsonArray scaleArray = object["scale"].toArray();
-        if (scaleArray.size() != 3) {
-            std::cout << "group scale must have 3 elements" << std::endl;
-            return false;
-        }
-        if (!scaleArray[0].isDouble() || !scaleArray[1].isDouble() || !scaleArray[2].isDouble()) {
-            std::cout << "group scale must contain floating-point values" << std::endl;
+        // Axis, then angle in degrees
+        float axisAngle[4];
+        if (!readFloats(fields.value(GroupField::GROUP_ROTATE), "group rotate", 4, axisAngle)) {
             return false;
         }
+        rotation->rotate = glm::vec3(axisAngle[0], axisAngle[1], axisAngle[2]);
+        rotation->angle = axisAngle[3] * M_PI / 180.f;
+    }
 
+    // parse scale if defined
+    if (fields.has(GroupField::GROUP_SCALE)) {
         SceneTransformation *scale = new SceneTransformation();
         scale->type = TransformationType::TRANSFORMATION_SCALE;
-        scale->scale.x = scaleArray[0].toDouble();
-        scale->scale.y = scaleArray[1].toDouble();
-        scale->scale.z = scaleArray[2].toDouble();
-
         node->transformations.push_back(scale);
+
+        if (!readFloats(fields.value(GroupField::GROUP_SCALE), "group scale", 3, glm::value_ptr(scale->scale))) {
+            return false;
+        }
     }
 
     // parse matrix if defined
-    if (object.contains("matrix")) {
-        if (!object["matrix"].isArray()) {
+    if (fields.has(GroupField::GROUP_MATRIX)) {
+        QJsonValue matrix = fields.value(GroupField::GROUP_MATRIX);
+        if (!matrix.isArray()) {
             std::cout << "group matrix must be of type array of array" << std::endl;
             return false;
         }
 
-        QJsonArray matrixArray = object["matrix"].toArray();
+        const QJsonArray matrixArray = matrix.toArray();
         if (matrixArray.size() != 4) {
             std::cout << "group matrix must be 4x4" << std::endl;
             return false;
@@ -677,46 +818,42 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
 
         SceneTransformation *matrixTransformation = new SceneTransformation();
         matrixTransformation->type = TransformationType::TRANSFORMATION_MATRIX;
+        node->transformations.push_back(matrixTransformation);
 
-        float *matrixPtr = glm::value_ptr(matrixTransformation->matrix);
-        int rowIndex = 0;
-        for (auto row : matrixArray) {
-            if (!row.isArray()) {
-                std::cout << "group matrix must be of type array of array" << std::endl;
-                return false;
-            }
-
-            QJsonArray rowArray = row.toArray();
-            if (rowArray.size() != 4) {
-                std::cout << "group matrix must be 4x4" << std::endl;
+        // Rows in the file, filled in column-wise
+        for (int row = 0; row < 4; row++) {
+            float values[4];
+            if (!readFloats(matrixArray.at(row), "group matrix row", 4, values)) {
                 return false;
             }
-
-            int colIndex = 0;
-            for (auto val : rowArray) {
-                if (!val.isDouble()) {
-                    std::cout << "group matrix must contain all floating-point values" << std::endl;
-                    return false;
-                }
-
-                // fill in column-wise
-                matrixPtr[colIndex * 4 + rowIndex] = (float)val.toDouble();
-                colIndex++;
+            for (int col = 0; col < 4; col++) {
+                matrixTransformation->matrix[col][row] = values[col];
             }
-            rowIndex++;
         }
+    }
 
-        node->transformations.push_back(matrixTransformation);
+    // Flattening reuses the composed transformations on every visit of the
+    // node. A projective matrix does not fit the affine form, so such groups
+    // keep only the list
+    bool affine = std::all_of(node->transformations.begin(), node->transformations.end(),
+                              [](const SceneTransformation *transformation) {
+                                  return transformation->type != TransformationType::TRANSFORMATION_MATRIX ||
+                                         isAffine(transformation->matrix);
+                              });
+    if (m_bakeLocalMatrices && affine) {
+        node->localMatrix = composeTransformations(node->transformations);
+        node->hasLocalMatrix = true;
     }
 
     // parse lights if any
-    if (object.contains("lights")) {
-        if (!object["lights"].isArray()) {
+    if (fields.has(GroupField::GROUP_LIGHTS)) {
+        QJsonValue lights = fields.value(GroupField::GROUP_LIGHTS);
+        if (!lights.isArray()) {
             std::cout << "group lights must be of type array" << std::endl;
             return false;
         }
-        QJsonArray lightsArray = object["lights"].toArray();
-        for (auto light : lightsArray) {
+        const QJsonArray lightsArray = lights.toArray();
+        for (const QJsonValue &light : lightsArray) {
             if (!light.isObject()) {
                 std::cout << "light must be of type object" << std::endl;
                 return false;
@@ -729,13 +866,15 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
     }
 
     // parse primitives if any
-    if (object.contains("primitives")) {
-        if (!object["primitives"].isArray()) {
+    if (fields.has(GroupField::GROUP_PRIMITIVES)) {
+        QJsonValue primitives = fields.value(GroupField::GROUP_PRIMITIVES);
+        if (!primitives.isArray()) {
             std::cout << "group primitives must be of type array" << std::endl;
             return false;
         }
-        QJsonArray primitivesArray = object["primitives"].toArray();
-        for (auto primitive : primitivesArray) {
+        const QJsonArray primitivesArray = primitives.toArray();
+        node->primitives.reserve(node->primitives.size() + primitivesArray.size());
+        for (const QJsonValue &primitive : primitivesArray) {
             if (!primitive.isObject()) {
                 std::cout << "primitive must be of type object" << std::endl;
                 return false;
@@ -747,9 +886,19 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
         }
     }
 
+    // link the root of an included scene file if any
+    if (fields.has(GroupField::GROUP_INCLUDE)) {
+        QJsonValue include = fields.value(GroupField::GROUP_INCLUDE);
+        if (!include.isString()) {
+            std::cout << "group include must be of type string" << std::endl;
+            return false;
+        }
+        node->children.push_back(includeScene(include.toString().toStdString()));
+    }
+
     // parse children groups if any
-    if (object.contains("groups")) {
-        if (!parseGroups(object["groups"], node)) {
+    if (fields.has(GroupField::GROUP_GROUPS)) {
+        if (!parseGroups(fields.value(GroupField::GROUP_GROUPS), node, nodes)) {
             return false;
         }
     }
@@ -757,39 +906,70 @@ bool ScenefileReader::parseGroupData(const QJsonObject &object, SceneNode *node)
     return true;
 }
 
-bool ScenefileReader::parseGroups(const QJsonValue &groups, SceneNode *parent) {
+bool ScenefileReader::parseGroups(const QJsonValue &groups, SceneNode *parent, std::vector<SceneNode *> &nodes) {
     if (!groups.isArray()) {
         std::cout << "groups must be of type array" << std::endl;
         return false;
     }
 
-    QJsonArray groupsArray = groups.toArray();
-    for (auto group : groupsArray) {
+    const QJsonArray groupsArray = groups.toArray();
+    return parseGroupRange(groupsArray, 0, groupsArray.size(), parent->children, nodes);
+}
+
+bool ScenefileReader::parseRootGroups(const QJsonValue &groups) {
+    if (!groups.isArray()) {
+        std::cout << "groups must be of type array" << std::endl;
+        return false;
+    }
+
+    // Chunks collect their children separately and are linked under the
+    // root afterwards, so the root's children keep their file order
+    const QJsonArray groupsArray = groups.toArray();
+    qsizetype count = groupsArray.size();
+    int chunks = chunkCount(count);
+    std::vector<std::vector<SceneNode *>> chunkChildren(chunks);
+    bool success = parseChunked(count, chunks, [&](int chunk, qsizetype begin, qsizetype end, std::vector<SceneNode *> &nodes) {
+        return parseGroupRange(groupsArray, begin, end, chunkChildren[chunk], nodes);
+    });
+
+    for (const std::vector<SceneNode *> &children : chunkChildren) {
+        m_root->children.insert(m_root->children.end(), children.begin(), children.end());
+    }
+    return success;
+}
+
+bool ScenefileReader::parseGroupRange(const QJsonArray &groups, qsizetype begin, qsizetype end,
+                                      std::vector<SceneNode *> &children, std::vector<SceneNode *> &nodes) {
+    for (qsizetype i = begin; i < end; i++) {
+        QJsonValue group = groups.at(i);
         if (!group.isObject()) {
             std::cout << "group items must be of type object" << std::endl;
             return false;
         }
 
-        QJsonObject groupData = group.toObject();
-        if (groupData.contains("name")) {
-            if (!groupData["name"].isString()) {
+        const QJsonObject groupData = group.toObject();
+        auto name = groupData.constFind(QLatin1String("name"));
+        if (name != groupData.constEnd()) {
+            if (!name.value().isString()) {
                 std::cout << "group name must be of type string" << std::endl;
                 return false;
             }
 
             // if its a reference to a template group append it
-            std::string groupName = groupData["name"].toString().toStdString();
-            if (m_templates.contains(groupName)) {
-                parent->children.push_back(m_templates[groupName]);
-                continue;
+            if (!m_templates.empty()) {
+                auto it = m_templates.find(name.value().toString().toStdString());
+                if (it != m_templates.end()) {
+                    children.push_back(it->second);
+                    continue;
+                }
             }
         }
 
         SceneNode *node = new SceneNode;
-        m_nodes.push_back(node);
-        parent->children.push_back(node);
+        nodes.push_back(node);
+        children.push_back(node);
 
-        if (!parseGroupData(group.toObject(), node)) {
+        if (!parseGroupData(groupData, node, nodes)) {
             return false;
         }
     }
@@ -797,34 +977,59 @@ bool ScenefileReader::parseGroups(const QJsonValue &groups, SceneNode *parent) {
     return true;
 }
 
+int ScenefileReader::chunkCount(qsizetype count) const {
+    if (!m_parallelGroups || count < 2 * MinGroupsPerChunk) {
+        return 1;
+    }
+    // A few chunks per thread, so that uneven subtrees still balance out
+    return (int)std::min<qsizetype>(QThread::idealThreadCount() * 4, count / MinGroupsPerChunk);
+}
+
+bool ScenefileReader::parseChunked(qsizetype count, int chunks, const ChunkParser &parseRange) {
+    if (chunks <= 1) {
+        return parseRange(0, 0, count, m_nodes);
+    }
+
+    // Chunk i covers [i * count / chunks, (i + 1) * count / chunks), and
+    // allocates its nodes into an arena of its own
+    std::vector<std::vector<SceneNode *>> arenas(chunks);
+    std::atomic<bool> success = true;
+    {
+        QThreadPool pool;
+        for (int chunk = 0; chunk < chunks; chunk++) {
+            qsizetype begin = chunk * count / chunks;
+            qsizetype end = (chunk + 1) * count / chunks;
+            pool.start([&, chunk, begin, end] {
+                if (success && !parseRange(chunk, begin, end, arenas[chunk])) {
+                    success = false;
+                }
+            });
+        }
+        pool.waitForDone();
+    }
+
+    // Nodes are owned by m_nodes even if parsing failed part way
+    for (const std::vector<SceneNode *> &arena : arenas) {
+        m_nodes.insert(m_nodes.end(), arena.begin(), arena.end());
+    }
+    return success;
+}
+
 /**
  * Parse an <object type="primitive"> tag into node.
  */
 bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
-    QStringList requiredFields = {"type"};
-    QStringList optionalFields = {
-        "meshFile", "ambient", "diffuse", "specular", "reflective", "transparent", "shininess", "ior",
-        "blend", "textureFile", "textureU", "textureV", "bumpMapFile", "bumpMapU", "bumpMapV"};
-
-    QStringList allFields = requiredFields + optionalFields;
-    for (auto field : prim.keys()) {
-        if (!allFields.contains(field)) {
-            std::cout << "unknown field \"" << field.toStdString() << "\" on primitive object" << std::endl;
-            return false;
-        }
-    }
-    for (auto field : requiredFields) {
-        if (!prim.contains(field)) {
-            std::cout << "missing required field \"" << field.toStdString() << "\" on primitive object" << std::endl;
-            return false;
-        }
+    ObjectFields<PrimitiveFields> fields;
+    if (!fields.read(prim, "primitive")) {
+        return false;
     }
 
-    if (!prim["type"].isString()) {
+    QJsonValue type = fields.value(PrimitiveField::PRIMITIVE_TYPE);
+    if (!type.isString()) {
         std::cout << "primitive type must be of type string" << std::endl;
         return false;
     }
-    std::string primType = prim["type"].toString().toStdString();
+    int primType = readKeyword(type, PrimitiveTypeNames);
 
     // Default primitive
     ScenePrimitive *primitive = new ScenePrimitive();
@@ -836,191 +1041,110 @@ bool ScenefileReader::parsePrimitive(const QJsonObject &prim, SceneNode *node) {
     mat.cDiffuse.r = mat.cDiffuse.g = mat.cDiffuse.b = 1;
     node->primitives.push_back(primitive);
 
-    std::filesystem::path basepath = std::filesystem::path(file_name).parent_path().parent_path();
-    if (primType == "sphere")
-        primitive->type = PrimitiveType::PRIMITIVE_SPHERE;
-    else if (primType == "cube")
-        primitive->type = PrimitiveType::PRIMITIVE_CUBE;
-    else if (primType == "cylinder")
-        primitive->type = PrimitiveType::PRIMITIVE_CYLINDER;
-    else if (primType == "cone")
-        primitive->type = PrimitiveType::PRIMITIVE_CONE;
-    else if (primType == "mesh") {
-        primitive->type = PrimitiveType::PRIMITIVE_MESH;
-        if (!prim.contains("meshFile")) {
-            std::cout << "primitive type mesh must contain field meshFile" << std::endl;
-            return false;
-        }
-        if (!prim["meshFile"].isString()) {
-            std::cout << "primitive meshFile must be of type string" << std::endl;
-            return false;
-        }
-
-        std::filesystem::path relativePath(prim["meshFile"].toString().toStdString());
-        primitive->meshfile = (basepath / relativePath).string();
-    }
-    else {
-        std::cout << "unknown primitive type \"" << primType << "\"" << std::endl;
+    if (primType < 0) {
+        std::cout << "unknown primitive type \"" << type.toString().toStdString() << "\"" << std::endl;
         return false;
     }
+    primitive->type = (PrimitiveType)primType;
 
-    if (prim.contains("ambient")) {
-        if (!prim["ambient"].isArray()) {
-            std::cout << "primitive ambient must be of type array" << std::endl;
+    if (primitive->type == PrimitiveType::PRIMITIVE_MESH) {
+        if (!fields.has(PrimitiveField::PRIMITIVE_MESH_FILE)) {
+            std::cout << "primitive type mesh must contain field meshFile" << std::endl;
             return false;
         }
-        QJsonArray ambientArray = prim["ambient"].toArray();
-        if (ambientArray.size() != 3) {
-            std::cout << "primitive ambient array must be of size 3" << std::endl;
+        if (!readPath(fields.value(PrimitiveField::PRIMITIVE_MESH_FILE), "primitive meshFile", m_basepath, primitive->meshfile)) {
             return false;
         }
-
-        for (int i = 0; i < 3; i++) {
-            if (!ambientArray[i].isDouble()) {
-                std::cout << "primitive ambient must contain floating-point values" << std::endl;
-                return false;
-            }
-
-            mat.cAmbient[i] = ambientArray[i].toDouble();
-        }
     }
 
-    if (prim.contains("diffuse")) {
-        if (!prim["diffuse"].isArray()) {
-            std::cout << "primitive diffuse must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray diffuseArray = prim["diffuse"].toArray();
-        if (diffuseArray.size() != 3) {
-            std::cout << "primitive diffuse array must be of size 3" << std::endl;
-            return false;
-        }
-
-        for (int i = 0; i < 3; i++) {
-            if (!diffuseArray[i].isDouble()) {
-                std::cout << "primitive diffuse must contain floating-point values" << std::endl;
+    // Colors only set their rgb
+    struct ColorField {
+        PrimitiveField field;
+        const char *what;
+        SceneColor *color;
+    };
+    for (const ColorField &color : {ColorField{PrimitiveField::PRIMITIVE_AMBIENT, "primitive ambient", &mat.cAmbient},
+                                    ColorField{PrimitiveField::PRIMITIVE_DIFFUSE, "primitive diffuse", &mat.cDiffuse},
+                                    ColorField{PrimitiveField::PRIMITIVE_SPECULAR, "primitive specular", &mat.cSpecular},
+                                    ColorField{PrimitiveField::PRIMITIVE_REFLECTIVE, "primitive reflective", &mat.cReflective},
+                                    ColorField{PrimitiveField::PRIMITIVE_TRANSPARENT, "primitive transparent", &mat.cTransparent}}) {
+        if (fields.has(color.field)) {
+            if (!readFloats(fields.value(color.field), color.what, 3, glm::value_ptr(*color.color))) {
                 return false;
             }
-
-            mat.cDiffuse[i] = diffuseArray[i].toDouble();
         }
     }
 
-    if (prim.contains("specular")) {
-        if (!prim["specular"].isArray()) {
-            std::cout << "primitive specular must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray specularArray = prim["specular"].toArray();
-        if (specularArray.size() != 3) {
-            std::cout << "primitive specular array must be of size 3" << std::endl;
+    if (fields.has(PrimitiveField::PRIMITIVE_SHININESS)) {
+        if (!readFloat(fields.value(PrimitiveField::PRIMITIVE_SHININESS), "primitive shininess", mat.shininess)) {
             return false;
         }
-
-        for (int i = 0; i < 3; i++) {
-            if (!specularArray[i].isDouble()) {
-                std::cout << "primitive specular must contain floating-point values" << std::endl;
-                return false;
-            }
-
-            mat.cSpecular[i] = specularArray[i].toDouble();
-        }
     }
 
-    if (prim.contains("reflective")) {
-        if (!prim["reflective"].isArray()) {
-            std::cout << "primitive reflective must be of type array" << std::endl;
-            return false;
-        }
-        QJsonArray reflectiveArray = prim["reflective"].toArray();
-        if (reflectiveArray.size() != 3) {
-            std::cout << "primitive reflective array must be of size 3" << std::endl;
+    if (fields.has(PrimitiveField::PRIMITIVE_IOR)) {
+        if (!readFloat(fields.value(PrimitiveField::PRIMITIVE_IOR), "primitive ior", mat.ior)) {
             return false;
         }
-
-        for (int i = 0; i < 3; i++) {
-            if (!reflectiveArray[i].isDouble()) {
-                std::cout << "primitive reflective must contain floating-point values" << std::endl;
-                return false;
-            }
-
-            mat.cReflective[i] = reflectiveArray[i].toDouble();
-        }
     }
 
-    if (prim.contains("transparent")) {
-        if (!prim["transparent"].isArray()) {
-            std::cout << "primitive transparent must be of type array" << std::endl;
+    if (fields.has(PrimitiveField::PRIMITIVE_BLEND)) {
+        if (!readFloat(fields.value(PrimitiveField::PRIMITIVE_BLEND), "primitive blend", mat.blend)) {
             return false;
         }
-        QJsonArray transparentArray = prim["transparent"].toArray();
-        if (transparentArray.size() != 3) {
-            std::cout << "primitive transparent array must be of size 3" << std::endl;
-            return false;
-        }
-
-        for (int i = 0; i < 3; i++) {
-            if (!transparentArray[i].isDouble()) {
-                std::cout << "primitive transparent must contain floating-point values" << std::endl;
-                return false;
-            }
+    }
 
-            mat.cTransparent[i] = transparentArray[i].toDouble();
+    // Repeats default to 1 when missing or not a number
+    auto readRepeat = [&](PrimitiveField field) {
+        if (!fields.has(field)) {
+            return 1.f;
         }
-    }
+        QJsonValue value = fields.value(field);
+        return value.isDouble() ? (float)value.toDouble() : 1.f;
+    };
 
-    if (prim.contains("shininess")) {
-        if (!prim["shininess"].isDouble()) {
-            std::cout << "primitive shininess must be of type float" << std::endl;
+    if (fields.has(PrimitiveField::PRIMITIVE_TEXTURE_FILE)) {
+        if (!readPath(fields.value(PrimitiveField::PRIMITIVE_TEXTURE_FILE), "primitive textureFile", m_basepath, mat.textureMap.filename)) {
             return false;
         }
-
-        mat.shininess = (float) prim["shininess"].toDouble();
+        mat.textureMap.repeatU = readRepeat(PrimitiveField::PRIMITIVE_TEXTURE_U);
+        mat.textureMap.repeatV = readRepeat(PrimitiveField::PRIMITIVE_TEXTURE_V);
+        mat.textureMap.isUsed = true;
     }
 
-    if (prim.contains("ior")) {
-        if (!prim["ior"].isDouble()) {
-            std::cout << "primitive ior must be of type float" << std::endl;
+    if (fields.has(PrimitiveField::PRIMITIVE_BUMP_MAP_FILE)) {
+        if (!readPath(fields.value(PrimitiveField::PRIMITIVE_BUMP_MAP_FILE), "primitive bumpMapFile", m_basepath, mat.bumpMap.filename)) {
             return false;
         }
-
-        mat.ior = (float) prim["ior"].toDouble();
+        mat.bumpMap.repeatU = readRepeat(PrimitiveField::PRIMITIVE_BUMP_MAP_U);
+        mat.bumpMap.repeatV = readRepeat(PrimitiveField::PRIMITIVE_BUMP_MAP_V);
+        mat.bumpMap.isUsed = true;
     }
 
-    if (prim.contains("blend")) {
-        if (!prim["blend"].isDouble()) {
-            std::cout << "primitive blend must be of type float" << std::endl;
-            return false;
-        }
+    return true;
+}
 
-        mat.blend = (float)prim["blend"].toDouble();
+bool convertSceneToCbor(const std::string &jsonFile, const std::string &cborFile) {
+    QByteArray contents;
+    std::string error;
+    if (!readSceneFile(jsonFile, contents, error)) {
+        std::cout << error << std::endl;
+        return false;
     }
 
-    if (prim.contains("textureFile")) {
-        if (!prim["textureFile"].isString()) {
-            std::cout << "primitive textureFile must be of type string" << std::endl;
-            return false;
-        }
-        std::filesystem::path fileRelativePath(prim["textureFile"].toString().toStdString());
-
-        mat.textureMap.filename = (basepath / fileRelativePath).string();
-        mat.textureMap.repeatU = prim.contains("textureU") && prim["textureU"].isDouble() ? prim["textureU"].toDouble() : 1;
-        mat.textureMap.repeatV = prim.contains("textureV") && prim["textureV"].isDouble() ? prim["textureV"].toDouble() : 1;
-        mat.textureMap.isUsed = true;
+    QJsonParseError jsonError;
+    QJsonDocument doc = QJsonDocument::fromJson(contents, &jsonError);
+    if (!doc.isObject()) {
+        std::cout << "could not parse " << jsonFile << ": " << jsonError.errorString().toStdString() << std::endl;
+        return false;
     }
 
-    if (prim.contains("bumpMapFile")) {
-        if (!prim["bumpMapFile"].isString()) {
-            std::cout << "primitive bumpMapFile must be of type string" << std::endl;
-            return false;
-        }
-        std::filesystem::path fileRelativePath(prim["bumpMapFile"].toString().toStdString());
+    // Whole numbers are stored as CBOR integers, and the rest as doubles
+    QCborValue scene(QCborKnownTags::Signature, QCborMap::fromJsonObject(doc.object()));
 
-        mat.bumpMap.filename = (basepath / fileRelativePath).string();
-        mat.bumpMap.repeatU = prim.contains("bumpMapU") && prim["bumpMapU"].isDouble() ? prim["bumpMapU"].toDouble() : 1;
-        mat.bumpMap.repeatV = prim.contains("bumpMapV") && prim["bumpMapV"].isDouble() ? prim["bumpMapV"].toDouble() : 1;
-        mat.bumpMap.isUsed = true;
+    QFile output(QString::fromStdString(cborFile));
+    if (!output.open(QFile::WriteOnly) || output.write(scene.toCbor()) < 0) {
+        std::cout << "could not write " << cborFile << std::endl;
+        return false;
     }
-
     return true;
 }
@@ -1,10 +1,16 @@
 #pragma once
 
 #include "scenedata.h"
+#include "scenededup.h"
 
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <map>
 
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 
@@ -17,9 +23,44 @@ public:
     // Clean up all data for the scene
     ~ScenefileReader();
 
-    // Parse the XML scene file. Returns false if scene is invalid.
+    // Parse the scene file, either JSON or CBOR with the same layout, and
+    // the scene files its groups include. Returns false if scene is invalid.
     bool readJSON();
 
+    // Parse contents as if they had been read from the scene file.
+    bool readContents(const QByteArray &contents);
+
+    // Parses a single JSON group object, such as one of the root's groups
+    // cut out of the scene file, with the template groups read so far. Every
+    // node it allocates goes into nodes, which the caller frees with
+    // deleteNodes. A group naming a template returns the template's node,
+    // which the reader keeps owning. Returns nullptr if the group is invalid.
+    SceneNode *parseDetachedGroup(const QByteArray &json, std::vector<SceneNode *> &nodes);
+
+    // Appends the path of every scene file that the file at path includes,
+    // directly or through other included files. Only reads the files, without
+    // building their scene graphs.
+    static void listIncludedFiles(const std::string &path, std::vector<std::string> &files);
+
+    // Deletes nodes along with their transformations, primitives and lights.
+    static void deleteNodes(std::vector<SceneNode *> &nodes);
+
+    // Parse sibling groups at the top of the scene and the template groups
+    // concurrently on a thread pool. On by default; the resulting graph is
+    // the same either way.
+    void setParallelGroups(bool parallel);
+
+    // Merge subtrees which are identical in everything but where they appear
+    // into one shared node after reading, as if they were references to a
+    // template group, and free the duplicates. On by default.
+    void setDeduplicateSubtrees(bool deduplicate);
+    SubtreeDedupStats getDedupStats() const;
+
+    // Store each group's transformations composed into SceneNode::localMatrix
+    // as well, next to the list itself, unless one of them is a projective
+    // matrix. On by default.
+    void setBakeLocalMatrices(bool bake);
+
     SceneGlobalData getGlobalData() const;
 
     SceneCameraData getCameraData() const;
@@ -27,18 +68,59 @@ public:
     SceneNode *getRootNode() const;
 
 private:
+    struct IncludeCache;
+
+    // The reader of a file included by another, which shares its cache
+    ScenefileReader(const std::string &filename, IncludeCache *includes);
+
+    // Returns the root of the scene file at path, relative to this file's
+    // directory, and starts parsing it on the cache's pool unless another
+    // group included it already.
+    SceneNode *includeScene(const std::string &path);
+    bool finishIncludes();
+    // Fails if reader or a file it includes failed to parse, or includes itself.
+    bool checkIncludes(ScenefileReader *reader, std::map<ScenefileReader *, int> &state) const;
+
+    bool deduplicateNodes();
+
+    bool parseSceneFile();
+    bool parseSceneContents(const QByteArray &fileContents);
+
+    bool isCborScene(const QByteArray &contents) const;
+    bool loadJson(const QByteArray &contents, QJsonObject &scenefile) const;
+    bool loadCbor(const QByteArray &contents, QJsonObject &scenefile) const;
+
     // The filename should be contained within this parser implementation.
     // If you want to parse a new file, instantiate a different parser.
     bool parseGlobalData(const QJsonObject &globaldata);
     bool parseCameraData(const QJsonObject &cameradata);
     bool parseTemplateGroups(const QJsonValue &templateGroups);
-    bool parseTemplateGroupData(const QJsonObject &templateGroup);
-    bool parseGroups(const QJsonValue &groups, SceneNode *parent);
-    bool parseGroupData(const QJsonObject &object, SceneNode *node);
+    // Fails if a template contains itself, directly or through other templates.
+    bool checkTemplateCycles(const std::vector<SceneNode *> &templateNodes);
+    bool parseTemplateGroupData(const QJsonObject &templateGroup, SceneNode *templateNode, std::vector<SceneNode *> &nodes);
+    bool parseRootGroups(const QJsonValue &groups);
+    bool parseGroups(const QJsonValue &groups, SceneNode *parent, std::vector<SceneNode *> &nodes);
+    bool parseGroupRange(const QJsonArray &groups, qsizetype begin, qsizetype end,
+                         std::vector<SceneNode *> &children, std::vector<SceneNode *> &nodes);
+    bool parseGroupData(const QJsonObject &object, SceneNode *node, std::vector<SceneNode *> &nodes);
     bool parsePrimitive(const QJsonObject &prim, SceneNode *node);
     bool parseLightData(const QJsonObject &lightData, SceneNode *node);
 
+    // Parses the items [begin, end) of one chunk, allocating nodes into the given arena
+    using ChunkParser = std::function<bool(int chunk, qsizetype begin, qsizetype end, std::vector<SceneNode *> &nodes)>;
+
+    // Groups below this many per chunk are not worth a task
+    static constexpr qsizetype MinGroupsPerChunk = 64;
+
+    int chunkCount(qsizetype count) const;
+    bool parseChunked(qsizetype count, int chunks, const ChunkParser &parseRange);
+
     std::string file_name;
+    bool m_parallelGroups = true;
+    bool m_deduplicateSubtrees = true;
+    bool m_bakeLocalMatrices = true;
+    SubtreeDedupStats m_dedupStats;
+    std::filesystem::path m_basepath;
 
     mutable std::map<std::string, SceneNode *> m_templates;
 
@@ -47,4 +129,15 @@ private:
 
     SceneNode *m_root;
     std::vector<SceneNode *> m_nodes;
+
+    // Scene files included by "include" groups, shared by the reader of the
+    // top-level file, which owns it, and the readers of the included files
+    std::unique_ptr<IncludeCache> m_ownedIncludes;
+    IncludeCache *m_includes;
+    std::atomic<bool> m_failed = false;
+    bool m_recordIncludes = true;
 };
+
+// Writes the JSON scene in jsonFile to cborFile as CBOR, which readJSON
+// reads back into the same scene graph.
+bool convertSceneToCbor(const std::string &jsonFile, const std::string &cborFile);
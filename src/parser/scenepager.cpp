@@ -0,0 +1,358 @@
+#include "scenepager.h"
+#include "affinebatch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <string_view>
+
+namespace {
+
+// Finds the byte range of every group in the root's "groups" array, and of
+// the array itself, by matching brackets outside of strings.
+bool scanRootGroups(std::string_view data, size_t &arrayBegin, size_t &arrayEnd,
+                    std::vector<std::pair<size_t, size_t>> &groups) {
+    int depth = 0;
+    bool inString = false;
+    bool inGroups = false;
+    bool found = false;
+    size_t stringStart = 0;
+    size_t groupBegin = 0;
+    std::string_view lastString;
+    std::string_view key;
+
+    for (size_t i = 0; i < data.size(); i++) {
+        char c = data[i];
+        if (inString) {
+            if (c == '\\') {
+                i++;
+            }
+            else if (c == '"') {
+                inString = false;
+                lastString = data.substr(stringStart, i - stringStart);
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            inString = true;
+            stringStart = i + 1;
+            break;
+        case ':':
+            if (depth == 1) {
+                key = lastString;
+            }
+            break;
+        case '{':
+        case '[':
+            if (depth == 1 && c == '[' && key == "groups" && !found) {
+                inGroups = true;
+                arrayBegin = i;
+            }
+            else if (inGroups && depth == 2 && c == '{') {
+                groupBegin = i;
+            }
+            depth++;
+            break;
+        case '}':
+        case ']':
+            depth--;
+            if (inGroups && depth == 2 && c == '}') {
+                groups.push_back({groupBegin, i + 1});
+            }
+            else if (inGroups && depth == 1) {
+                inGroups = false;
+                found = true;
+                arrayEnd = i + 1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return found && depth == 0;
+}
+
+size_t residentSize(const ScenePrimitive &primitive) {
+    return sizeof(RenderShapeData) + primitive.meshfile.size() + primitive.material.textureMap.filename.size() +
+           primitive.material.bumpMap.filename.size();
+}
+
+float distanceTo(const glm::vec3 &point, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    return glm::length(glm::max(glm::max(boundsMin - point, point - boundsMax), glm::vec3(0.f)));
+}
+
+// Groups parsed per task while pre-scanning
+constexpr size_t PrescanBatch = 256;
+
+const glm::vec4 UnitCubeCorners[8] = {
+    {-0.5f, -0.5f, -0.5f, 1.f}, {0.5f, -0.5f, -0.5f, 1.f}, {-0.5f, 0.5f, -0.5f, 1.f}, {0.5f, 0.5f, -0.5f, 1.f},
+    {-0.5f, -0.5f, 0.5f, 1.f},  {0.5f, -0.5f, 0.5f, 1.f},  {-0.5f, 0.5f, 0.5f, 1.f},  {0.5f, 0.5f, 0.5f, 1.f},
+};
+
+// The world-space bounds and resident size of a group, measured from its
+// nodes without flattening them into shapes
+struct GroupExtent {
+    glm::vec3 boundsMin = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+    size_t bytes = 0;
+    bool unbounded = false;
+};
+
+// Composes node's transformations into ctm, from the matrix the reader
+// baked if it did, or else from the list while it stays affine. Returns
+// false once one of them is projective.
+bool applyTransformations(const SceneNode *node, glm::mat4x3 &ctm) {
+    if (node->hasLocalMatrix) {
+        ctm = affineMultiply(ctm, node->localMatrix);
+        return true;
+    }
+    for (const SceneTransformation *transformation : node->transformations) {
+        if (transformation->type == TransformationType::TRANSFORMATION_MATRIX && !isAffine(transformation->matrix)) {
+            return false;
+        }
+    }
+    ctm = affineMultiply(ctm, composeTransformations(node->transformations));
+    return true;
+}
+
+void measureNode(const SceneNode *node, glm::mat4x3 ctm, bool affine, GroupExtent &extent) {
+    affine = affine && applyTransformations(node, ctm);
+
+    for (const ScenePrimitive *primitive : node->primitives) {
+        extent.bytes += residentSize(*primitive);
+    }
+    extent.bytes += node->lights.size() * sizeof(SceneLightData);
+
+    if (!affine) {
+        // A projective transform can put the shapes anywhere, so the group is never far
+        extent.unbounded = extent.unbounded || !node->primitives.empty() || !node->lights.empty();
+    }
+    else {
+        // Every primitive, meshes included, is taken to fill the unit cube,
+        // so a node's primitives share one set of corners
+        if (!node->primitives.empty()) {
+            glm::vec4 corners[8];
+            affineTransformBatch(ctm, UnitCubeCorners, corners, 8);
+            for (const glm::vec4 &corner : corners) {
+                extent.boundsMin = glm::min(extent.boundsMin, glm::vec3(corner));
+                extent.boundsMax = glm::max(extent.boundsMax, glm::vec3(corner));
+            }
+        }
+        if (!node->lights.empty()) {
+            extent.boundsMin = glm::min(extent.boundsMin, ctm[3]);
+            extent.boundsMax = glm::max(extent.boundsMax, ctm[3]);
+        }
+    }
+
+    for (const SceneNode *child : node->children) {
+        measureNode(child, ctm, affine, extent);
+    }
+}
+
+} // namespace
+
+ScenePager::ScenePager() {
+    // Pages load one at a time, nearest first
+    m_loader.setMaxThreadCount(1);
+}
+
+ScenePager::~ScenePager() {
+    {
+        QMutexLocker locker(&m_mutex);
+        for (Page &page : m_pages) {
+            page.wanted = false;
+        }
+    }
+    m_loader.waitForDone();
+}
+
+bool ScenePager::open(const std::string &path) {
+    m_file.setFileName(QString::fromStdString(path));
+    if (!m_file.open(QFile::ReadOnly)) {
+        std::cout << "could not open " << path << std::endl;
+        return false;
+    }
+    size_t size = (size_t)m_file.size();
+    m_data = size > 0 ? (const char *)m_file.map(0, (qint64)size) : nullptr;
+    if (m_data == nullptr) {
+        std::cout << "could not map " << path << " for paging" << std::endl;
+        return false;
+    }
+
+    std::string_view data(m_data, size);
+    size_t arrayBegin = 0;
+    size_t arrayEnd = 0;
+    std::vector<std::pair<size_t, size_t>> groups;
+    if (!scanRootGroups(data, arrayBegin, arrayEnd, groups)) {
+        std::cout << path << " has no groups to page, or is not uncompressed JSON" << std::endl;
+        return false;
+    }
+
+    // Everything but the groups stays resident
+    QByteArray base;
+    base.reserve((qsizetype)(size - (arrayEnd - arrayBegin) + 2));
+    base.append(m_data, (qsizetype)arrayBegin);
+    base.append("[]");
+    base.append(m_data + arrayEnd, (qsizetype)(size - arrayEnd));
+
+    m_reader = std::make_unique<ScenefileReader>(path);
+    if (!m_reader->readContents(base)) {
+        return false;
+    }
+    m_baseData = RenderData{};
+    m_baseData.globalData = m_reader->getGlobalData();
+    m_baseData.cameraData = m_reader->getCameraData();
+
+    // Each group is parsed once up front for its bounds and size, which are
+    // measured from its nodes rather than by flattening it
+    m_pages.resize(groups.size());
+    std::atomic<bool> success = true;
+    {
+        QThreadPool pool;
+        for (size_t first = 0; first < groups.size(); first += PrescanBatch) {
+            pool.start([&, first] {
+                for (size_t i = first; i < std::min(first + PrescanBatch, groups.size()); i++) {
+                    Page &page = m_pages[i];
+                    page.begin = groups[i].first;
+                    page.end = groups[i].second;
+
+                    std::vector<SceneNode *> nodes;
+                    QByteArray json = QByteArray::fromRawData(m_data + page.begin, (qsizetype)(page.end - page.begin));
+                    SceneNode *root = m_reader->parseDetachedGroup(json, nodes);
+                    if (root == nullptr) {
+                        success = false;
+                        continue;
+                    }
+
+                    GroupExtent extent;
+                    measureNode(root, affineIdentity(), true, extent);
+                    ScenefileReader::deleteNodes(nodes);
+                    if (extent.unbounded) {
+                        extent.boundsMin = glm::vec3(-std::numeric_limits<float>::max());
+                        extent.boundsMax = glm::vec3(std::numeric_limits<float>::max());
+                    }
+                    page.boundsMin = extent.boundsMin;
+                    page.boundsMax = extent.boundsMax;
+                    page.bytes = extent.bytes;
+                }
+            });
+        }
+        pool.waitForDone();
+    }
+
+    std::cout << "Indexed " << m_pages.size() << " pageable groups in " << path << std::endl;
+    return success;
+}
+
+void ScenePager::setMemoryBudget(size_t bytes) {
+    m_budget = bytes;
+    m_planned = false;
+}
+
+size_t ScenePager::residentBytes() const {
+    QMutexLocker locker(&m_mutex);
+    size_t bytes = 0;
+    for (const Page &page : m_pages) {
+        bytes += page.data ? page.bytes : 0;
+    }
+    return bytes;
+}
+
+void ScenePager::update(const glm::vec3 &cameraPos) {
+    if (m_planned && cameraPos == m_lastCamera) {
+        return;
+    }
+    m_planned = true;
+    m_lastCamera = cameraPos;
+
+    // Nearest groups first, until the budget is spent
+    std::vector<float> distances(m_pages.size());
+    for (size_t i = 0; i < m_pages.size(); i++) {
+        distances[i] = distanceTo(cameraPos, m_pages[i].boundsMin, m_pages[i].boundsMax);
+    }
+    std::vector<size_t> order(m_pages.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return distances[a] < distances[b]; });
+
+    bool changed = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        size_t planned = 0;
+        for (size_t i : order) {
+            Page &page = m_pages[i];
+            page.wanted = planned + page.bytes <= m_budget;
+            if (page.wanted) {
+                planned += page.bytes;
+                if (!page.data && !page.loading) {
+                    page.loading = true;
+                    m_loader.start([this, i] { load(i); });
+                }
+            }
+            else if (page.data) {
+                page.data.reset();
+                changed = true;
+            }
+        }
+    }
+
+    if (changed) {
+        emit pagesChanged();
+    }
+}
+
+void ScenePager::collect(RenderData &renderData) const {
+    QMutexLocker locker(&m_mutex);
+    for (const Page &page : m_pages) {
+        if (page.data) {
+            renderData.shapes.insert(renderData.shapes.end(), page.data->shapes.begin(), page.data->shapes.end());
+            renderData.lights.insert(renderData.lights.end(), page.data->lights.begin(), page.data->lights.end());
+        }
+    }
+}
+
+bool ScenePager::readPage(const Page &page, PageData &data) const {
+    std::vector<SceneNode *> nodes;
+    QByteArray json = QByteArray::fromRawData(m_data + page.begin, (qsizetype)(page.end - page.begin));
+    SceneNode *root = m_reader->parseDetachedGroup(json, nodes);
+    if (root != nullptr) {
+        // Flattened by the same code as whole scenes
+        RenderData group;
+        SceneParser::flattenGroup(root, glm::mat4(1.f), group);
+        data.shapes = std::move(group.shapes);
+        data.lights = std::move(group.lights);
+    }
+    ScenefileReader::deleteNodes(nodes);
+    return root != nullptr;
+}
+
+void ScenePager::load(size_t index) {
+    Page &page = m_pages[index];
+    {
+        // The camera may have moved on since this load was queued
+        QMutexLocker locker(&m_mutex);
+        if (!page.wanted) {
+            page.loading = false;
+            return;
+        }
+    }
+
+    auto data = std::make_shared<PageData>();
+    bool success = readPage(page, *data);
+
+    bool changed = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        page.loading = false;
+        if (success && page.wanted) {
+            page.data = std::move(data);
+            changed = true;
+        }
+    }
+    if (changed) {
+        emit pagesChanged();
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "scenefilereader.h"
+#include "sceneparser.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QFile>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+
+// Keeps the root's groups of a scene file too large for memory on disk, and
+// pages them in and out by their distance to the camera under a memory
+// budget. Opening the file records the byte range and world-space bounds of
+// every group; only those, the global data, the camera and the template
+// groups stay resident. Pages load on a background thread.
+//
+// Paged scenes must be uncompressed JSON, so that groups can be read by offset.
+class ScenePager : public QObject {
+    Q_OBJECT
+
+public:
+    ScenePager();
+    ~ScenePager();
+
+    // Pre-scans the scene file. Returns false if it cannot be paged.
+    bool open(const std::string &path);
+
+    // Global data, camera and lights of the scene without any of its groups.
+    const RenderData &baseData() const { return m_baseData; }
+
+    // Bytes the resident groups' shapes and lights may take up.
+    void setMemoryBudget(size_t bytes);
+    size_t residentBytes() const;
+
+    // Requests the groups nearest to the camera that fit the budget, and
+    // evicts those which no longer fit.
+    void update(const glm::vec3 &cameraPos);
+
+    // Appends the shapes and lights of every resident group.
+    void collect(RenderData &renderData) const;
+
+    size_t pageCount() const { return m_pages.size(); }
+
+signals:
+    // A group was paged in or out.
+    void pagesChanged();
+
+private:
+    struct PageData {
+        std::vector<RenderShapeData> shapes;
+        std::vector<SceneLightData> lights;
+    };
+
+    struct Page {
+        size_t begin = 0;
+        size_t end = 0;
+        glm::vec3 boundsMin = glm::vec3(0.f);
+        glm::vec3 boundsMax = glm::vec3(0.f);
+        size_t bytes = 0;
+        bool wanted = false;
+        bool loading = false;
+        std::shared_ptr<const PageData> data;
+    };
+
+    bool readPage(const Page &page, PageData &data) const;
+    void load(size_t index);
+
+    std::unique_ptr<ScenefileReader> m_reader;
+    QFile m_file;
+    const char *m_data = nullptr;
+    RenderData m_baseData;
+
+    std::vector<Page> m_pages;
+    mutable QMutex m_mutex; // Guards each page's wanted, loading and data
+    QThreadPool m_loader;
+
+    size_t m_budget = size_t(2) << 30;
+    glm::vec3 m_lastCamera = glm::vec3(0.f);
+    bool m_planned = false;
+};
@@ -54,7 +54,15 @@ bool SceneParser::parse(std::string filepath, RenderData &renderData) {
 
     // Task 6: populate renderData's list of primitives and their transforms.
     //         This will involve traversing the scene graph, and we recommend you
-    //         create a helper function to do so!
+    //         create a helper function to do so! (see flattenGroup below)
 
     return true;
 }
+
+void SceneParser::flattenGroup(SceneNode *node, const glm::mat4 &ctm, RenderData &renderData) {
+    // Task 6: append the primitives and lights of node and its children to
+    //         renderData. Large scenes are paged one root group at a time
+    //         through this function, so call it from parse for the root too.
+    //         Nodes with hasLocalMatrix set already hold their transformations
+    //         composed into localMatrix.
+}
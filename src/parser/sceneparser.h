@@ -27,5 +27,11 @@ public:
     // @return            A boolean value indicating whether the parse was successful.
     static bool parse(std::string filepath, RenderData &renderData);
 
+    // Appends the primitives and lights of node and everything below it to
+    // renderData, with ctm the cumulative transformation of node's parent.
+    // The scene pager flattens each group it pages in with this, from a
+    // worker thread.
+    static void flattenGroup(SceneNode *node, const glm::mat4 &ctm, RenderData &renderData);
+
     static void debugDFS();
 };
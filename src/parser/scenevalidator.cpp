@@ -0,0 +1,756 @@
+#include "scenevalidator.h"
+#include "scenedecompressor.h"
+#include "scenefields.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <set>
+
+#include <QFile>
+#include <QThreadPool>
+
+namespace {
+
+bool isNumberStart(char c) {
+    return c == '-' || (c >= '0' && c <= '9');
+}
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+void appendUtf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+        out += (char)code;
+    }
+    else if (code < 0x800) {
+        out += (char)(0xc0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+    else if (code < 0x10000) {
+        out += (char)(0xe0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+    else {
+        out += (char)(0xf0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3f));
+        out += (char)(0x80 | ((code >> 6) & 0x3f));
+        out += (char)(0x80 | (code & 0x3f));
+    }
+}
+
+std::string describe(std::string_view object, std::string_view field, const char *problem) {
+    std::string message;
+    message.reserve(object.size() + field.size() + 40);
+    message.append(object).append(" ").append(field).append(" ").append(problem);
+    return message;
+}
+
+} // namespace
+
+// The fields seen on one object, and where the object starts
+template <const auto &Table>
+struct SceneValidator::FieldSet {
+    using Field = typename std::remove_cvref_t<decltype(Table)>::FieldType;
+
+    bool has(Field field) const { return seen[(size_t)field]; }
+
+    std::array<bool, std::remove_cvref_t<decltype(Table)>::FieldCount> seen{};
+    size_t offset = 0;
+    bool isObject = false;
+};
+
+bool SceneValidator::validateFile(const std::string &path, bool included) {
+    m_errors.clear();
+
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QFile::ReadOnly)) {
+        m_errors.push_back({0, 1, 1, "could not open " + path});
+        return false;
+    }
+
+    // Map uncompressed files where possible so they are never copied
+    qint64 size = file.size();
+    bool compressed = detectCompression(file.peek(4)) != SceneCompression::COMPRESSION_NONE;
+    if (uchar *mapped = size > 0 && !compressed ? file.map(0, size) : nullptr) {
+        return validate(std::string_view((const char *)mapped, (size_t)size), included);
+    }
+
+    QByteArray contents;
+    std::string error;
+    if (!readSceneFile(path, contents, error)) {
+        m_errors.push_back({0, 1, 1, error});
+        return false;
+    }
+    return validate(std::string_view(contents.constData(), (size_t)contents.size()), included);
+}
+
+bool SceneValidator::validate(std::string_view data, bool included) {
+    m_data = data;
+    m_pos = 0;
+    m_depth = 0;
+    m_templateNames.clear();
+    m_errors.clear();
+    m_includes.clear();
+
+    if (m_data.starts_with("\xd9\xd9\xf7")) {
+        error(0, "CBOR scenes are not supported by the validator; check the JSON they were converted from");
+    }
+    else if ((included ? readRoot<IncludedRootFields>() : readRoot<RootFields>()) && peek() != '\0') {
+        syntaxError("unexpected characters after the document");
+    }
+
+    // Missing fields are reported at the start of their object once it has
+    // been read, so put the errors back into file order
+    std::stable_sort(m_errors.begin(), m_errors.end(),
+                     [](const ValidationError &a, const ValidationError &b) { return a.offset < b.offset; });
+
+    int line = 1;
+    size_t lineStart = 0;
+    size_t pos = 0;
+    for (ValidationError &error : m_errors) {
+        for (; pos < error.offset && pos < m_data.size(); pos++) {
+            if (m_data[pos] == '\n') {
+                line++;
+                lineStart = pos + 1;
+            }
+        }
+        error.line = line;
+        error.column = (int)(error.offset - lineStart) + 1;
+    }
+
+    m_data = {};
+    return m_errors.empty();
+}
+
+template <const auto &Table>
+bool SceneValidator::readRoot() {
+    if (peek() != '{') {
+        if (m_pos < m_data.size()) {
+            error(m_pos, "document is not an object");
+            return false;
+        }
+        return syntaxError("expected a value");
+    }
+
+    FieldSet<Table> fields;
+    return readFields<Table>("root", fields, [&](RootField field) {
+        switch (field) {
+        case RootField::ROOT_GLOBAL_DATA:
+            return readGlobalData();
+        case RootField::ROOT_CAMERA_DATA:
+            return readCameraData();
+        case RootField::ROOT_GROUPS:
+            return readGroups("root", "groups", false);
+        case RootField::ROOT_TEMPLATE_GROUPS:
+            return readGroups("root", "templateGroups", true);
+        default:
+            return skipValue();
+        }
+    });
+}
+
+bool SceneValidator::readGlobalData() {
+    FieldSet<GlobalFields> fields;
+    return readFields<GlobalFields>("globalData", fields, [&](GlobalField field) {
+        return readNumber("globalData", GlobalFields.name(field));
+    });
+}
+
+bool SceneValidator::readCameraData() {
+    FieldSet<CameraFields> fields;
+    bool ok = readFields<CameraFields>("cameraData", fields, [&](CameraField field) {
+        switch (field) {
+        case CameraField::CAMERA_POSITION:
+        case CameraField::CAMERA_UP:
+        case CameraField::CAMERA_LOOK:
+        case CameraField::CAMERA_FOCUS:
+            return readNumbers("cameraData", CameraFields.name(field), 3);
+        default:
+            return readNumber("cameraData", CameraFields.name(field));
+        }
+    });
+
+    if (fields.has(CameraField::CAMERA_LOOK) && fields.has(CameraField::CAMERA_FOCUS)) {
+        error(fields.offset, "cameraData cannot contain both \"look\" and \"focus\"");
+    }
+    return ok;
+}
+
+bool SceneValidator::readGroups(std::string_view object, std::string_view field, bool templates) {
+    if (peek() != '[') {
+        error(m_pos, describe(object, field, "must be of type array"));
+        return skipValue();
+    }
+    return readArray([&](int) { return readGroup(templates); });
+}
+
+bool SceneValidator::readGroup(bool isTemplate) {
+    const char *objectName = isTemplate ? "templateGroup" : "group";
+    auto onField = [&](GroupField field) {
+        switch (field) {
+        case GroupField::GROUP_NAME: {
+            size_t offset = m_pos;
+            std::string_view name;
+            bool isString;
+            if (!readStringValue(objectName, "name", name, isString)) {
+                return false;
+            }
+            if (isTemplate && isString && !m_templateNames.emplace(name).second) {
+                error(offset, "templateGroups cannot have the same name \"" + std::string(name) + "\"");
+            }
+            return true;
+        }
+        case GroupField::GROUP_TRANSLATE:
+        case GroupField::GROUP_SCALE:
+            return readNumbers("group", GroupFields.name(field), 3);
+        case GroupField::GROUP_ROTATE:
+            return readNumbers("group", "rotate", 4);
+        case GroupField::GROUP_MATRIX:
+            return readMatrix();
+        case GroupField::GROUP_LIGHTS:
+            if (peek() != '[') {
+                error(m_pos, "group lights must be of type array");
+                return skipValue();
+            }
+            return readArray([&](int) { return readLight(); });
+        case GroupField::GROUP_PRIMITIVES:
+            if (peek() != '[') {
+                error(m_pos, "group primitives must be of type array");
+                return skipValue();
+            }
+            return readArray([&](int) { return readPrimitive(); });
+        case GroupField::GROUP_GROUPS:
+            return readGroups("group", "groups", false);
+        case GroupField::GROUP_INCLUDE: {
+            std::string_view path;
+            bool isString;
+            if (!readStringValue("group", "include", path, isString)) {
+                return false;
+            }
+            if (isString) {
+                m_includes.emplace_back(path);
+            }
+            return true;
+        }
+        }
+        return skipValue();
+    };
+
+    if (isTemplate) {
+        FieldSet<TemplateGroupFields> fields;
+        return readFields<TemplateGroupFields>(objectName, fields, onField);
+    }
+    FieldSet<GroupFields> fields;
+    return readFields<GroupFields>(objectName, fields, onField);
+}
+
+bool SceneValidator::readMatrix() {
+    if (peek() != '[') {
+        error(m_pos, "group matrix must be of type array of array");
+        return skipValue();
+    }
+
+    size_t offset = m_pos;
+    int rows = 0;
+    bool ok = readArray([&](int) {
+        rows++;
+        return readNumbers("group", "matrix row", 4);
+    });
+    if (ok && rows != 4) {
+        error(offset, "group matrix must be 4x4");
+    }
+    return ok;
+}
+
+bool SceneValidator::readLight() {
+    FieldSet<LightFields> fields;
+    int type = -1;
+    bool ok = readFields<LightFields>("light", fields, [&](LightField field) {
+        switch (field) {
+        case LightField::LIGHT_TYPE: {
+            size_t offset = m_pos;
+            std::string_view name;
+            bool isString;
+            if (!readStringValue("light", "type", name, isString)) {
+                return false;
+            }
+            if (isString) {
+                type = LightTypeNames.find(name);
+                if (type < 0) {
+                    error(offset, "unknown light type \"" + std::string(name) + "\"");
+                }
+            }
+            return true;
+        }
+        case LightField::LIGHT_COLOR:
+        case LightField::LIGHT_ATTENUATION_COEFF:
+        case LightField::LIGHT_DIRECTION:
+            return readNumbers("light", LightFields.name(field), 3);
+        case LightField::LIGHT_PENUMBRA:
+        case LightField::LIGHT_ANGLE:
+            return readNumber("light", LightFields.name(field));
+        default:
+            return skipValue();
+        }
+    });
+
+    // The type may come after the fields it requires, so check them last
+    if (type >= 0) {
+        LightRequirements requirements = lightRequirements((LightType)type);
+        for (LightField field : requirements.fields) {
+            if (!fields.has(field)) {
+                error(fields.offset, std::string(requirements.name) + " must contain field \"" +
+                                         std::string(LightFields.name(field)) + "\"");
+            }
+        }
+    }
+    return ok;
+}
+
+bool SceneValidator::readPrimitive() {
+    FieldSet<PrimitiveFields> fields;
+    int type = -1;
+    bool ok = readFields<PrimitiveFields>("primitive", fields, [&](PrimitiveField field) {
+        std::string_view value;
+        bool isString;
+        switch (field) {
+        case PrimitiveField::PRIMITIVE_TYPE: {
+            size_t offset = m_pos;
+            if (!readStringValue("primitive", "type", value, isString)) {
+                return false;
+            }
+            if (isString) {
+                type = PrimitiveTypeNames.find(value);
+                if (type < 0) {
+                    error(offset, "unknown primitive type \"" + std::string(value) + "\"");
+                }
+            }
+            return true;
+        }
+        case PrimitiveField::PRIMITIVE_MESH_FILE:
+        case PrimitiveField::PRIMITIVE_TEXTURE_FILE:
+        case PrimitiveField::PRIMITIVE_BUMP_MAP_FILE:
+            return readStringValue("primitive", PrimitiveFields.name(field), value, isString);
+        case PrimitiveField::PRIMITIVE_AMBIENT:
+        case PrimitiveField::PRIMITIVE_DIFFUSE:
+        case PrimitiveField::PRIMITIVE_SPECULAR:
+        case PrimitiveField::PRIMITIVE_REFLECTIVE:
+        case PrimitiveField::PRIMITIVE_TRANSPARENT:
+            return readNumbers("primitive", PrimitiveFields.name(field), 3);
+        case PrimitiveField::PRIMITIVE_SHININESS:
+        case PrimitiveField::PRIMITIVE_IOR:
+        case PrimitiveField::PRIMITIVE_BLEND:
+            return readNumber("primitive", PrimitiveFields.name(field));
+        default:
+            // Texture repeats fall back to 1 when they are not numbers
+            return skipValue();
+        }
+    });
+
+    if (type == (int)PrimitiveType::PRIMITIVE_MESH && !fields.has(PrimitiveField::PRIMITIVE_MESH_FILE)) {
+        error(fields.offset, "primitive type mesh must contain field meshFile");
+    }
+    return ok;
+}
+
+template <const auto &Table, typename OnField>
+bool SceneValidator::readFields(const char *objectName, FieldSet<Table> &fields, OnField onField) {
+    using Field = typename FieldSet<Table>::Field;
+
+    fields.offset = m_pos;
+    if (peek() != '{') {
+        error(m_pos, std::string(objectName) + " must be of type object");
+        return skipValue();
+    }
+    fields.isObject = true;
+
+    bool ok = readObject([&](std::string_view key, size_t keyOffset) {
+        int field = Table.find(key);
+        if (field < 0) {
+            error(keyOffset, "unknown field \"" + std::string(key) + "\" on " + objectName + " object");
+            return skipValue();
+        }
+        fields.seen[field] = true;
+        return onField((Field)field);
+    });
+    if (!ok) {
+        return false;
+    }
+
+    for (size_t i = 0; i < fields.seen.size(); i++) {
+        if (Table.isRequired((Field)i) && !fields.seen[i]) {
+            error(fields.offset, "missing required field \"" + std::string(Table.name((Field)i)) + "\" on " +
+                                     objectName + " object");
+        }
+    }
+    return true;
+}
+
+bool SceneValidator::readNumber(std::string_view object, std::string_view field) {
+    if (!isNumberStart(peek())) {
+        error(m_pos, describe(object, field, "must be a floating-point value"));
+        return skipValue();
+    }
+    return scanNumber(nullptr);
+}
+
+bool SceneValidator::readNumbers(std::string_view object, std::string_view field, int count) {
+    if (peek() != '[') {
+        error(m_pos, describe(object, field, "must be of type array"));
+        return skipValue();
+    }
+
+    size_t offset = m_pos;
+    int size = 0;
+    bool allNumbers = true;
+    bool ok = readArray([&](int) {
+        size++;
+        if (isNumberStart(peek())) {
+            return scanNumber(nullptr);
+        }
+        if (allNumbers) {
+            error(m_pos, describe(object, field, "must contain floating-point values"));
+            allNumbers = false;
+        }
+        return skipValue();
+    });
+    if (ok && size != count) {
+        error(offset, describe(object, field, "must have ") + std::to_string(count) + " elements");
+    }
+    return ok;
+}
+
+bool SceneValidator::readStringValue(std::string_view object, std::string_view field, std::string_view &value,
+                                     bool &isString) {
+    isString = peek() == '"';
+    if (!isString) {
+        error(m_pos, describe(object, field, "must be of type string"));
+        return skipValue();
+    }
+    return readString(value);
+}
+
+template <typename OnMember>
+bool SceneValidator::readObject(OnMember onMember) {
+    if (++m_depth > MaxDepth) {
+        return syntaxError("document is nested too deeply");
+    }
+    m_pos++;
+
+    if (peek() == '}') {
+        m_pos++;
+        m_depth--;
+        return true;
+    }
+    while (true) {
+        if (peek() != '"') {
+            return syntaxError("expected a member name");
+        }
+        size_t keyOffset = m_pos;
+        std::string_view key;
+        if (!readString(key)) {
+            return false;
+        }
+        if (peek() != ':') {
+            return syntaxError("expected ':'");
+        }
+        m_pos++;
+        if (!onMember(key, keyOffset)) {
+            return false;
+        }
+
+        char c = peek();
+        m_pos++;
+        if (c == '}') {
+            m_depth--;
+            return true;
+        }
+        if (c != ',') {
+            m_pos--;
+            return syntaxError("expected ',' or '}'");
+        }
+    }
+}
+
+template <typename OnElement>
+bool SceneValidator::readArray(OnElement onElement) {
+    if (++m_depth > MaxDepth) {
+        return syntaxError("document is nested too deeply");
+    }
+    m_pos++;
+
+    if (peek() == ']') {
+        m_pos++;
+        m_depth--;
+        return true;
+    }
+    for (int index = 0;; index++) {
+        if (!onElement(index)) {
+            return false;
+        }
+
+        char c = peek();
+        m_pos++;
+        if (c == ']') {
+            m_depth--;
+            return true;
+        }
+        if (c != ',') {
+            m_pos--;
+            return syntaxError("expected ',' or ']'");
+        }
+    }
+}
+
+bool SceneValidator::readString(std::string_view &value) {
+    size_t start = ++m_pos;
+
+    // Most strings have no escapes and are returned in place
+    for (; m_pos < m_data.size(); m_pos++) {
+        char c = m_data[m_pos];
+        if (c == '"') {
+            value = m_data.substr(start, m_pos - start);
+            m_pos++;
+            return true;
+        }
+        if (c == '\\') {
+            break;
+        }
+        if ((unsigned char)c < 0x20) {
+            return syntaxError("control character in string");
+        }
+    }
+
+    m_string.assign(m_data.data() + start, std::min(m_pos, m_data.size()) - start);
+    while (m_pos < m_data.size()) {
+        char c = m_data[m_pos];
+        if (c == '"') {
+            value = m_string;
+            m_pos++;
+            return true;
+        }
+        if ((unsigned char)c < 0x20) {
+            return syntaxError("control character in string");
+        }
+        if (c != '\\') {
+            m_string += c;
+            m_pos++;
+            continue;
+        }
+
+        if (m_pos + 1 >= m_data.size()) {
+            break;
+        }
+        char escape = m_data[m_pos + 1];
+        m_pos += 2;
+        switch (escape) {
+        case '"':
+        case '\\':
+        case '/':
+            m_string += escape;
+            break;
+        case 'b':
+            m_string += '\b';
+            break;
+        case 'f':
+            m_string += '\f';
+            break;
+        case 'n':
+            m_string += '\n';
+            break;
+        case 'r':
+            m_string += '\r';
+            break;
+        case 't':
+            m_string += '\t';
+            break;
+        case 'u': {
+            auto readHex = [&](uint32_t &code) {
+                if (m_pos + 4 > m_data.size()) {
+                    return false;
+                }
+                auto [end, ec] = std::from_chars(m_data.data() + m_pos, m_data.data() + m_pos + 4, code, 16);
+                if (ec != std::errc() || end != m_data.data() + m_pos + 4) {
+                    return false;
+                }
+                m_pos += 4;
+                return true;
+            };
+            uint32_t code;
+            if (!readHex(code)) {
+                return syntaxError("invalid \\u escape");
+            }
+            // Join surrogate pairs; lone surrogates become U+FFFD, as in QJsonDocument
+            if (code >= 0xd800 && code < 0xdc00 && m_data.substr(m_pos, 2) == "\\u") {
+                m_pos += 2;
+                uint32_t low;
+                if (!readHex(low)) {
+                    return syntaxError("invalid \\u escape");
+                }
+                code = low >= 0xdc00 && low < 0xe000 ? 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00) : 0xfffd;
+            }
+            else if (code >= 0xd800 && code < 0xe000) {
+                code = 0xfffd;
+            }
+            appendUtf8(m_string, code);
+            break;
+        }
+        default:
+            m_pos -= 2;
+            return syntaxError("invalid escape sequence");
+        }
+    }
+    return syntaxError("unterminated string");
+}
+
+bool SceneValidator::scanNumber(double *value) {
+    size_t start = m_pos;
+    size_t pos = m_pos;
+    auto digits = [&] {
+        size_t first = pos;
+        while (pos < m_data.size() && isDigit(m_data[pos])) {
+            pos++;
+        }
+        return pos > first;
+    };
+
+    if (pos < m_data.size() && m_data[pos] == '-') {
+        pos++;
+    }
+    if (pos < m_data.size() && m_data[pos] == '0') {
+        pos++;
+    }
+    else if (!digits()) {
+        return syntaxError("invalid number");
+    }
+    if (pos < m_data.size() && m_data[pos] == '.') {
+        pos++;
+        if (!digits()) {
+            m_pos = pos;
+            return syntaxError("invalid number");
+        }
+    }
+    if (pos < m_data.size() && (m_data[pos] == 'e' || m_data[pos] == 'E')) {
+        pos++;
+        if (pos < m_data.size() && (m_data[pos] == '+' || m_data[pos] == '-')) {
+            pos++;
+        }
+        if (!digits()) {
+            m_pos = pos;
+            return syntaxError("invalid number");
+        }
+    }
+
+    if (value) {
+        std::from_chars(m_data.data() + start, m_data.data() + pos, *value);
+    }
+    m_pos = pos;
+    return true;
+}
+
+bool SceneValidator::skipValue() {
+    char c = peek();
+    switch (c) {
+    case '{':
+        return readObject([&](std::string_view, size_t) { return skipValue(); });
+    case '[':
+        return readArray([&](int) { return skipValue(); });
+    case '"': {
+        std::string_view value;
+        return readString(value);
+    }
+    default:
+        break;
+    }
+
+    if (isNumberStart(c)) {
+        return scanNumber(nullptr);
+    }
+    for (std::string_view literal : {"true", "false", "null"}) {
+        if (m_data.substr(m_pos, literal.size()) == literal) {
+            m_pos += literal.size();
+            return true;
+        }
+    }
+    return syntaxError(m_pos < m_data.size() ? "expected a value" : "unexpected end of document");
+}
+
+char SceneValidator::peek() {
+    while (m_pos < m_data.size()) {
+        char c = m_data[m_pos];
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+            return c;
+        }
+        m_pos++;
+    }
+    return '\0';
+}
+
+void SceneValidator::error(size_t offset, std::string message) {
+    m_errors.push_back({offset, 0, 0, std::move(message)});
+}
+
+bool SceneValidator::syntaxError(const char *message) {
+    error(m_pos, message);
+    return false;
+}
+
+int validateSceneFiles(const std::vector<std::string> &paths, bool included) {
+    struct Result {
+        std::vector<ValidationError> errors;
+        std::vector<std::string> includes;
+    };
+
+    // Each file is validated by a task of its own; the errors are printed
+    // afterwards so that they come out in the order the files were given,
+    // followed by the files they include, each checked once
+    std::vector<std::string> files = paths;
+    std::vector<Result> results;
+    std::set<std::string> visited;
+    size_t begin = 0;
+    while (begin < files.size()) {
+        size_t end = files.size();
+        results.resize(end);
+        {
+            QThreadPool pool;
+            for (size_t i = begin; i < end; i++) {
+                pool.start([&, i] {
+                    SceneValidator validator;
+                    validator.validateFile(files[i], included || i >= paths.size());
+                    results[i] = {validator.errors(), validator.includes()};
+                });
+            }
+            pool.waitForDone();
+        }
+
+        // Relative to the including file, as in ScenefileReader::includeScene
+        for (size_t i = begin; i < end; i++) {
+            for (const std::string &include : results[i].includes) {
+                std::filesystem::path includePath = std::filesystem::path(files[i]).parent_path() / include;
+                std::error_code error;
+                std::filesystem::path canonical = std::filesystem::weakly_canonical(includePath, error);
+                if (visited.insert(error ? includePath.string() : canonical.string()).second) {
+                    files.push_back(includePath.string());
+                }
+            }
+        }
+        begin = end;
+    }
+
+    size_t invalid = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        for (const ValidationError &error : results[i].errors) {
+            std::cout << files[i] << ":" << error.line << ":" << error.column << " (byte " << error.offset
+                      << "): " << error.message << "\n";
+        }
+        invalid += !results[i].errors.empty();
+    }
+    std::cout << files.size() - invalid << " of " << files.size() << " scene files are valid" << std::endl;
+    return invalid == 0 ? 0 : 1;
+}
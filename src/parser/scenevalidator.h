@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// An error found by SceneValidator, at a byte offset into the scene file.
+struct ValidationError {
+    size_t offset;
+    int line;
+    int column;
+    std::string message;
+};
+
+// Checks a JSON scene file against the rules ScenefileReader applies, in a
+// single streaming pass over its bytes and without building a document or a
+// scene graph. Unlike the reader, it reports every schema error rather than
+// stopping at the first; only JSON syntax errors end the pass.
+class SceneValidator {
+public:
+    // Validates the scene in data. Returns false if it has any errors.
+    // Included scenes are checked as the reader parses them, without the
+    // root fields only the including scene needs.
+    bool validate(std::string_view data, bool included = false);
+
+    // Validates the scene file at path.
+    bool validateFile(const std::string &path, bool included = false);
+
+    // The errors of the last validation, in file order.
+    const std::vector<ValidationError> &errors() const { return m_errors; }
+
+    // The "include" paths of the last validation, as written in the scene
+    const std::vector<std::string> &includes() const { return m_includes; }
+
+private:
+    template <const auto &Table>
+    struct FieldSet;
+
+    // Schema rules; these return false only on syntax errors
+    template <const auto &Table>
+    bool readRoot();
+    bool readGlobalData();
+    bool readCameraData();
+    bool readGroups(std::string_view object, std::string_view field, bool templates);
+    bool readGroup(bool isTemplate);
+    bool readMatrix();
+    bool readLight();
+    bool readPrimitive();
+
+    template <const auto &Table, typename OnField>
+    bool readFields(const char *objectName, FieldSet<Table> &fields, OnField onField);
+
+    bool readNumber(std::string_view object, std::string_view field);
+    bool readNumbers(std::string_view object, std::string_view field, int count);
+    bool readStringValue(std::string_view object, std::string_view field, std::string_view &value, bool &isString);
+
+    // JSON syntax
+    template <typename OnMember>
+    bool readObject(OnMember onMember);
+    template <typename OnElement>
+    bool readArray(OnElement onElement);
+    bool readString(std::string_view &value);
+    bool scanNumber(double *value);
+    bool skipValue();
+
+    char peek();
+    void error(size_t offset, std::string message);
+    bool syntaxError(const char *message);
+
+    static constexpr int MaxDepth = 512;
+
+    std::string_view m_data;
+    size_t m_pos = 0;
+    int m_depth = 0;
+    std::string m_string; // Holds strings with escape sequences once decoded
+    std::unordered_set<std::string> m_templateNames;
+    std::vector<ValidationError> m_errors;
+    std::vector<std::string> m_includes;
+};
+
+// Validates each scene file on the available cores, along with every file
+// they include, printing every error and a summary. With included set, the
+// given files are themselves checked as included scenes. Returns 0 if all
+// files are valid, or 1 otherwise.
+int validateSceneFiles(const std::vector<std::string> &paths, bool included = false);
@@ -0,0 +1,178 @@
+#include "scenewatcher.h"
+#include "scenefilereader.h"
+
+#include <iostream>
+
+#include <QFile>
+
+namespace {
+
+// Editors often save in several writes, so a change is handled once the
+// files have been quiet for this long
+constexpr int SettleMilliseconds = 100;
+
+QSet<QString> textureFiles(const RenderData &renderData) {
+    QSet<QString> files;
+    for (const RenderShapeData &shape : renderData.shapes) {
+        const SceneFileMap &textureMap = shape.primitive.material.textureMap;
+        if (textureMap.isUsed && !textureMap.filename.empty()) {
+            files.insert(QString::fromStdString(textureMap.filename));
+        }
+    }
+    return files;
+}
+
+} // namespace
+
+SceneWatcher::SceneWatcher() {
+    m_parser.setMaxThreadCount(1);
+    m_settle.setSingleShot(true);
+    m_settle.setInterval(SettleMilliseconds);
+    connect(&m_settle, &QTimer::timeout, this, &SceneWatcher::settled);
+    connect(&m_watcher, &QFileSystemWatcher::fileChanged, this, &SceneWatcher::fileChanged);
+}
+
+SceneWatcher::~SceneWatcher() {
+    stop();
+    m_parser.waitForDone();
+}
+
+void SceneWatcher::watch(const std::string &path, const RenderData &renderData) {
+    stop();
+    m_path = path;
+    setSceneFiles({});
+    m_textureFiles = textureFiles(renderData);
+    watchFiles();
+
+    // Which files the scene includes is only known once they are read, which is left to the parser thread
+    m_parser.start([this, path, generation = m_generation] {
+        auto includedFiles = std::make_shared<std::vector<std::string>>();
+        ScenefileReader::listIncludedFiles(path, *includedFiles);
+        QMetaObject::invokeMethod(this, [this, generation, includedFiles] {
+            if (generation == m_generation) {
+                setSceneFiles(*includedFiles);
+                watchFiles();
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SceneWatcher::stop() {
+    QStringList files = m_watcher.files();
+    if (!files.isEmpty()) {
+        m_watcher.removePaths(files);
+    }
+    m_settle.stop();
+    m_path.clear();
+    m_sceneFiles.clear();
+    m_textureFiles.clear();
+    m_sceneEdited = false;
+    m_editedTextures.clear();
+    m_pending = false;
+    m_hasScene = false;
+    m_scene = RenderData{};
+    m_generation++;
+}
+
+bool SceneWatcher::takeScene(RenderData &renderData) {
+    if (!m_hasScene) {
+        return false;
+    }
+    renderData = std::move(m_scene);
+    m_scene = RenderData{};
+    m_hasScene = false;
+    return true;
+}
+
+void SceneWatcher::fileChanged(const QString &path) {
+    // Saving by replacing the file drops it from the watcher
+    if (!m_watcher.files().contains(path) && QFile::exists(path)) {
+        m_watcher.addPath(path);
+    }
+    if (m_sceneFiles.contains(path)) {
+        m_sceneEdited = true;
+    }
+    if (m_textureFiles.contains(path)) {
+        m_editedTextures.insert(path);
+    }
+    m_settle.start();
+}
+
+void SceneWatcher::settled() {
+    if (m_sceneEdited) {
+        m_sceneEdited = false;
+        reparse();
+    }
+    if (!m_editedTextures.isEmpty()) {
+        QStringList paths = m_editedTextures.values();
+        m_editedTextures.clear();
+        emit texturesChanged(paths);
+    }
+}
+
+void SceneWatcher::reparse() {
+    if (m_path.empty()) {
+        return;
+    }
+    if (m_parsing) {
+        m_pending = true;
+        return;
+    }
+
+    m_parsing = true;
+    m_parser.start([this, path = m_path, generation = m_generation] {
+        auto parse = std::make_shared<Parse>();
+        parse->success = SceneParser::parse(path, parse->renderData);
+        if (parse->success) {
+            ScenefileReader::listIncludedFiles(path, parse->includedFiles);
+        }
+        QMetaObject::invokeMethod(this, [this, generation, parse] { parsed(generation, parse); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void SceneWatcher::parsed(unsigned generation, const std::shared_ptr<Parse> &parse) {
+    m_parsing = false;
+    if (generation == m_generation) {
+        if (parse->success) {
+            setSceneFiles(parse->includedFiles);
+            m_textureFiles = textureFiles(parse->renderData);
+            watchFiles();
+            m_scene = std::move(parse->renderData);
+            m_hasScene = true;
+            emit sceneChanged();
+        }
+        else {
+            std::cout << "could not reload " << m_path << ", keeping the current scene" << std::endl;
+        }
+    }
+
+    if (m_pending) {
+        m_pending = false;
+        reparse();
+    }
+}
+
+void SceneWatcher::setSceneFiles(const std::vector<std::string> &includedFiles) {
+    m_sceneFiles.clear();
+    m_sceneFiles.insert(QString::fromStdString(m_path));
+    for (const std::string &file : includedFiles) {
+        m_sceneFiles.insert(QString::fromStdString(file));
+    }
+}
+
+void SceneWatcher::watchFiles() {
+    QSet<QString> wanted = m_sceneFiles + m_textureFiles;
+    QStringList stale;
+    for (const QString &file : m_watcher.files()) {
+        if (!wanted.remove(file)) {
+            stale.push_back(file);
+        }
+    }
+    if (!stale.isEmpty()) {
+        m_watcher.removePaths(stale);
+    }
+    if (!wanted.isEmpty()) {
+        m_watcher.addPaths(wanted.values());
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "sceneparser.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+#include <QTimer>
+
+// Watches a scene file, the scene files it includes and the textures its
+// materials use. A change to a scene file parses the scene again on a
+// background thread; a scene which fails to parse, as a file being edited
+// often does, is reported and skipped. A change to a texture is only
+// reported, since the scene itself stays the same.
+class SceneWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    SceneWatcher();
+    ~SceneWatcher();
+
+    // Starts watching path. renderData is the scene as currently loaded from it.
+    void watch(const std::string &path, const RenderData &renderData);
+    void stop();
+
+    // Moves the last parsed version of the scene into renderData. Returns
+    // false if there is none.
+    bool takeScene(RenderData &renderData);
+
+signals:
+    // A new version of the scene was parsed.
+    void sceneChanged();
+    // The given texture files changed on disk.
+    void texturesChanged(const QStringList &paths);
+
+private:
+    struct Parse {
+        RenderData renderData;
+        std::vector<std::string> includedFiles;
+        bool success = false;
+    };
+
+    void fileChanged(const QString &path);
+    void settled();
+    void reparse();
+    void parsed(unsigned generation, const std::shared_ptr<Parse> &parse);
+    void setSceneFiles(const std::vector<std::string> &includedFiles);
+    void watchFiles();
+
+    QFileSystemWatcher m_watcher;
+    QTimer m_settle;
+    std::string m_path;
+    QSet<QString> m_sceneFiles; // The scene file and the files it includes
+    QSet<QString> m_textureFiles;
+    bool m_sceneEdited = false;
+    QSet<QString> m_editedTextures;
+
+    // Scenes are parsed one at a time; a change made meanwhile parses again after
+    QThreadPool m_parser;
+    bool m_parsing = false;
+    bool m_pending = false;
+    unsigned m_generation = 0; // Tells results for an earlier watch apart
+
+    RenderData m_scene;
+    bool m_hasScene = false;
+};
@@ -0,0 +1,130 @@
+#include "shapeorder.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+constexpr int CodeBits = 21; // Per axis, so three axes fit 64 bits
+constexpr uint32_t CodeMax = (1u << CodeBits) - 1;
+
+// Spreads the low 21 bits of v out to every third bit
+uint64_t spreadBits(uint32_t v) {
+    uint64_t x = v & CodeMax;
+    x = (x | (x << 32)) & 0x1f00000000ffffull;
+    x = (x | (x << 16)) & 0x1f0000ff0000ffull;
+    x = (x | (x << 8)) & 0x100f00f00f00f00full;
+    x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x << 2)) & 0x1249249249249249ull;
+    return x;
+}
+
+// The first coordinate takes the most significant bit of each level
+uint64_t interleave(const uint32_t (&axes)[3]) {
+    return (spreadBits(axes[0]) << 2) | (spreadBits(axes[1]) << 1) | spreadBits(axes[2]);
+}
+
+// Skilling's transform ("Programming the Hilbert curve", 2004) of the
+// coordinates into the transposed Hilbert index, whose interleaved bits are
+// the position along the curve
+uint64_t hilbertCode(uint32_t (&axes)[3]) {
+    constexpr uint32_t Top = 1u << (CodeBits - 1);
+    for (uint32_t q = Top; q > 1; q >>= 1) {
+        uint32_t p = q - 1;
+        for (uint32_t &axis : axes) {
+            if (axis & q) {
+                axes[0] ^= p;
+            }
+            else {
+                uint32_t t = (axes[0] ^ axis) & p;
+                axes[0] ^= t;
+                axis ^= t;
+            }
+        }
+    }
+
+    // Gray code
+    axes[1] ^= axes[0];
+    axes[2] ^= axes[1];
+    uint32_t t = 0;
+    for (uint32_t q = Top; q > 1; q >>= 1) {
+        if (axes[2] & q) {
+            t ^= q - 1;
+        }
+    }
+    for (uint32_t &axis : axes) {
+        axis ^= t;
+    }
+    return interleave(axes);
+}
+
+} // namespace
+
+bool parseShapeOrder(const std::string &name, ShapeOrder &order) {
+    if (name == "scene") {
+        order = ShapeOrder::SHAPE_ORDER_SCENE;
+    }
+    else if (name == "morton") {
+        order = ShapeOrder::SHAPE_ORDER_MORTON;
+    }
+    else if (name == "hilbert") {
+        order = ShapeOrder::SHAPE_ORDER_HILBERT;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+const char *shapeOrderName(ShapeOrder order) {
+    switch (order) {
+    case ShapeOrder::SHAPE_ORDER_MORTON:
+        return "morton";
+    case ShapeOrder::SHAPE_ORDER_HILBERT:
+        return "hilbert";
+    default:
+        return "scene";
+    }
+}
+
+void orderShapes(std::vector<RenderShapeData> &shapes, ShapeOrder order, std::vector<uint32_t> &originalIndices) {
+    originalIndices.resize(shapes.size());
+    std::iota(originalIndices.begin(), originalIndices.end(), 0);
+    if (order == ShapeOrder::SHAPE_ORDER_SCENE || shapes.size() < 2) {
+        return;
+    }
+
+    // Primitives are centered on the origin of their object space
+    glm::vec3 boundsMin(std::numeric_limits<float>::max());
+    glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+    for (const RenderShapeData &shape : shapes) {
+        boundsMin = glm::min(boundsMin, glm::vec3(shape.ctm[3]));
+        boundsMax = glm::max(boundsMax, glm::vec3(shape.ctm[3]));
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    // An axis all shapes share, as in a flat scene, maps every one to cell 0
+    glm::vec3 scale(0.f);
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0.f ? CodeMax / extent[axis] : 0.f;
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(shapes.size());
+    for (size_t i = 0; i < shapes.size(); i++) {
+        glm::vec3 cell = glm::clamp((glm::vec3(shapes[i].ctm[3]) - boundsMin) * scale, glm::vec3(0.f), glm::vec3(CodeMax));
+        uint32_t axes[3] = {(uint32_t)cell.x, (uint32_t)cell.y, (uint32_t)cell.z};
+        uint64_t code = order == ShapeOrder::SHAPE_ORDER_HILBERT ? hilbertCode(axes) : interleave(axes);
+        keys[i] = {code, (uint32_t)i};
+    }
+    // The index breaks ties, which keeps the sort stable
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<RenderShapeData> ordered;
+    ordered.reserve(shapes.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        ordered.push_back(std::move(shapes[keys[i].second]));
+        originalIndices[i] = keys[i].second;
+    }
+    shapes = std::move(ordered);
+}
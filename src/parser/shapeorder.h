@@ -0,0 +1,26 @@
+#pragma once
+
+#include "sceneparser.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The order shapes are kept in after flattening.
+enum class ShapeOrder {
+    SHAPE_ORDER_SCENE,   // Depth-first order of the scene graph
+    SHAPE_ORDER_MORTON,  // Along the Z-order curve through the shapes' centroids
+    SHAPE_ORDER_HILBERT  // Along the Hilbert curve through the shapes' centroids
+};
+
+// Reads "scene", "morton" or "hilbert".
+bool parseShapeOrder(const std::string &name, ShapeOrder &order);
+const char *shapeOrderName(ShapeOrder order);
+
+// Sorts shapes along the order's space-filling curve, by the world-space
+// centroid of each shape quantized to 21 bits per axis within the bounds of
+// all the centroids, so shapes near each other in space end up near each
+// other in memory. Shapes on the same cell of the curve keep their relative
+// order. On return originalIndices[i] is the index before sorting of the
+// shape now at i.
+void orderShapes(std::vector<RenderShapeData> &shapes, ShapeOrder order, std::vector<uint32_t> &originalIndices);
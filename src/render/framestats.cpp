@@ -0,0 +1,57 @@
+#include "framestats.h"
+
+bool GpuFrameTimer::create() {
+    for (auto &query : m_queries) {
+        query = std::make_unique<QOpenGLTimerQuery>();
+        if (!query->create()) {
+            destroy();
+            return false;
+        }
+    }
+    m_pending.fill(false);
+    m_next = 0;
+    m_latestMs = -1.0;
+    return true;
+}
+
+void GpuFrameTimer::destroy() {
+    for (auto &query : m_queries) {
+        if (query) {
+            query->destroy();
+            query.reset();
+        }
+    }
+}
+
+void GpuFrameTimer::begin() {
+    if (!m_queries[0]) {
+        return;
+    }
+    collect();
+
+    m_timing = !m_pending[m_next];
+    if (m_timing) {
+        m_queries[m_next]->begin();
+    }
+}
+
+void GpuFrameTimer::end() {
+    if (!m_timing) {
+        return;
+    }
+    m_queries[m_next]->end();
+    m_pending[m_next] = true;
+    m_next = (m_next + 1) % RingSize;
+    m_timing = false;
+}
+
+void GpuFrameTimer::collect() {
+    // Oldest first, so the newest resolved frame is the one that sticks
+    for (int k = 0; k < RingSize; k++) {
+        int i = (m_next + k) % RingSize;
+        if (m_pending[i] && m_queries[i]->isResultAvailable()) {
+            m_latestMs = m_queries[i]->waitForResult() / 1e6;
+            m_pending[i] = false;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include <QOpenGLTimerQuery>
+
+// Counters and timings of one rendered frame.
+struct FrameStats {
+    double cpuMs = 0.0;      // Time spent in paintGL, including uploads
+    double gpuMs = -1.0;     // GPU time of the latest frame whose timer has resolved; -1 if unknown
+    uint32_t drawCalls = 0;  // GL draw calls issued; a multi-draw counts once
+    uint32_t batches = 0;    // Meshes drawn, each instanced
+    uint32_t instances = 0;
+    uint64_t triangles = 0;
+    uint32_t culled = 0;     // Shapes skipped by frustum culling
+};
+
+// Measures GPU frame time with a ring of timer queries. Results are read a
+// few frames late, once they are available, so timing never stalls the CPU.
+class GpuFrameTimer {
+public:
+    // Requires a current context. Returns false if timer queries are not supported.
+    bool create();
+    void destroy();
+
+    // Bracket the GL commands of a frame. A frame is not timed if every query
+    // in the ring is still waiting for its result.
+    void begin();
+    void end();
+
+    // The GPU time of the most recent frame that has resolved, in milliseconds, or -1.
+    double latestMs() const { return m_latestMs; }
+
+private:
+    void collect();
+
+    static constexpr int RingSize = 4;
+    std::array<std::unique_ptr<QOpenGLTimerQuery>, RingSize> m_queries;
+    std::array<bool, RingSize> m_pending{};
+    int m_next = 0;
+    bool m_timing = false;
+    double m_latestMs = -1.0;
+};
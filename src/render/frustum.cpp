@@ -0,0 +1,41 @@
+#include "frustum.h"
+
+Frustum Frustum::fromMatrix(const glm::mat4 &viewProj) {
+    // Gribb/Hartmann: each plane is the fourth row plus or minus another row
+    glm::mat4 m = glm::transpose(viewProj);
+    Frustum frustum;
+    frustum.planes[0] = m[3] + m[0]; // left
+    frustum.planes[1] = m[3] - m[0]; // right
+    frustum.planes[2] = m[3] + m[1]; // bottom
+    frustum.planes[3] = m[3] - m[1]; // top
+    frustum.planes[4] = m[3] + m[2]; // near
+    frustum.planes[5] = m[3] - m[2]; // far
+    for (glm::vec4 &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+bool Frustum::intersects(const glm::mat4x3 &model, const MeshBounds &bounds) const {
+    glm::vec3 center;
+    glm::vec3 halfExtent;
+    transformBounds(model, bounds, center, halfExtent);
+    return intersects(center, halfExtent);
+}
+
+bool Frustum::intersects(const glm::vec3 &center, const glm::vec3 &halfExtent) const {
+    for (const glm::vec4 &plane : planes) {
+        glm::vec3 normal = glm::vec3(plane);
+        if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), halfExtent) < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void transformBounds(const glm::mat4x3 &model, const MeshBounds &bounds, glm::vec3 &center, glm::vec3 &halfExtent) {
+    glm::vec3 localHalfExtent = bounds.extent * 0.5f;
+    center = model * glm::vec4(bounds.min + localHalfExtent, 1.f);
+    glm::mat3 absLinear = glm::mat3(glm::abs(model[0]), glm::abs(model[1]), glm::abs(model[2]));
+    halfExtent = absLinear * localHalfExtent;
+}
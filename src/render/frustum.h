@@ -0,0 +1,25 @@
+#pragma once
+
+#include "render/vertexformat.h"
+
+#include <array>
+#include <glm/glm.hpp>
+
+// The six planes of a view volume, for culling shapes before they are drawn.
+struct Frustum {
+    // Normalized planes with inward-facing normals: dot(xyz, p) + w >= 0 inside
+    std::array<glm::vec4, 6> planes;
+
+    // Extracts the planes of a combined projection * view matrix.
+    static Frustum fromMatrix(const glm::mat4 &viewProj);
+
+    // Returns false only if the box, transformed by model, lies entirely
+    // outside one of the planes.
+    bool intersects(const glm::mat4x3 &model, const MeshBounds &bounds) const;
+
+    // The same for a world-space box given by its center and half extent.
+    bool intersects(const glm::vec3 &center, const glm::vec3 &halfExtent) const;
+};
+
+// The world-space axis-aligned box around bounds transformed by model.
+void transformBounds(const glm::mat4x3 &model, const MeshBounds &bounds, glm::vec3 &center, glm::vec3 &halfExtent);
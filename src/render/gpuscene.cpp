@@ -0,0 +1,102 @@
+#include "gpuscene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+uint32_t MaterialTable::indexOf(const SceneMaterial &material, uint32_t texture) {
+    GpuMaterial gpu;
+    gpu.ambient = glm::vec4(glm::vec3(material.cAmbient), 0.f);
+    gpu.diffuse = glm::vec4(glm::vec3(material.cDiffuse), 0.f);
+    gpu.specular = glm::vec4(glm::vec3(material.cSpecular), material.shininess);
+    if (texture != 0) {
+        gpu.texture = glm::vec4(material.blend, material.textureMap.repeatU, material.textureMap.repeatV, (float)texture);
+    }
+    else {
+        gpu.texture = glm::vec4(0.f);
+    }
+
+    Key key;
+    std::memcpy(key.data(), &gpu, sizeof(GpuMaterial));
+
+    auto it = m_indices.find(key);
+    if (it != m_indices.end()) {
+        return it->second;
+    }
+
+    uint32_t index = (uint32_t)m_materials.size();
+    m_materials.push_back(gpu);
+    m_indices.emplace(key, index);
+    return index;
+}
+
+void MaterialTable::clear() {
+    m_materials.clear();
+    m_indices.clear();
+}
+
+size_t MaterialTable::KeyHash::operator()(const Key &key) const {
+    size_t h = 0;
+    for (float f : key) {
+        h = h * 31 + std::hash<float>()(f);
+    }
+    return h;
+}
+
+float lightRange(const SceneLightData &light) {
+    if (light.type == LightType::LIGHT_DIRECTIONAL) {
+        return -1.f;
+    }
+
+    // Solve c0 + c1 * d + c2 * d^2 = k for the distance where intensity hits the cutoff
+    float brightest = std::max({light.color.r, light.color.g, light.color.b});
+    float k = brightest / LightCutoff;
+    float c0 = light.function.x;
+    float c1 = light.function.y;
+    float c2 = light.function.z;
+
+    if (c0 >= k) {
+        return 0.f;
+    }
+    if (c2 > 0.f) {
+        return (-c1 + std::sqrt(c1 * c1 - 4.f * c2 * (c0 - k))) / (2.f * c2);
+    }
+    if (c1 > 0.f) {
+        return (k - c0) / c1;
+    }
+    return -1.f;
+}
+
+uint32_t packLights(const RenderData &renderData, const glm::vec3 &headlightPos, std::vector<GpuLight> &lights) {
+    lights.clear();
+
+    if (renderData.lights.empty()) {
+        GpuLight light;
+        light.position = glm::vec4(headlightPos, (float)LightType::LIGHT_POINT);
+        light.direction = glm::vec4(0.f);
+        light.color = glm::vec4(1.f, 1.f, 1.f, -1.f);
+        light.attenuation = glm::vec4(1.f, 0.f, 0.f, 0.f);
+        lights.push_back(light);
+        return 1;
+    }
+
+    std::vector<GpuLight> clustered;
+    for (const SceneLightData &src : renderData.lights) {
+        GpuLight light;
+        light.position = glm::vec4(glm::vec3(src.pos), (float)src.type);
+        light.direction = glm::vec4(glm::vec3(src.dir), src.angle);
+        light.color = glm::vec4(glm::vec3(src.color), lightRange(src));
+        light.attenuation = glm::vec4(src.function, src.penumbra);
+
+        if (light.color.w == 0.f) {
+            // Never brighter than the cutoff
+            continue;
+        }
+        (light.color.w < 0.f ? lights : clustered).push_back(light);
+    }
+
+    uint32_t globalCount = (uint32_t)lights.size();
+    lights.insert(lights.end(), clustered.begin(), clustered.end());
+    return globalCount;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "parser/sceneparser.h"
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Light contributions below this intensity are cut off, which bounds the range
+// of attenuated lights for clustering.
+constexpr float LightCutoff = 1.f / 256.f;
+
+// A material as stored in the material buffer texture, MaterialTexels texels per material.
+struct GpuMaterial {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular; // w = shininess
+    glm::vec4 texture;  // blend, repeatU, repeatV, index of the texture plus one or 0
+};
+constexpr int MaterialTexels = sizeof(GpuMaterial) / sizeof(glm::vec4);
+
+// A light as stored in the light buffer texture, LightTexels texels per light.
+struct GpuLight {
+    glm::vec4 position;    // w = LightType
+    glm::vec4 direction;   // w = angle, in radians
+    glm::vec4 color;       // w = range, or -1 if the light reaches everywhere
+    glm::vec4 attenuation; // xyz = attenuation function, w = penumbra, in radians
+};
+constexpr int LightTexels = sizeof(GpuLight) / sizeof(glm::vec4);
+
+// Contents of the std140 Scene uniform block.
+struct GpuSceneBlock {
+    glm::vec4 globalCoeffs;  // ka, kd, ks, kt
+    glm::ivec4 lightCounts;  // x = global lights, which come first in the light buffer; y = all lights
+    glm::vec4 clusterParams; // xy = tiles per framebuffer pixel, z = slice scale, w = slice bias
+    glm::ivec4 clusterDims;  // tiles x, tiles y, slices
+};
+
+// Deduplicated table of the materials used by a scene. Shapes refer to their
+// material by index, so instanced draws can share one table upload.
+class MaterialTable {
+public:
+    // Returns the index of the material, adding it to the table if it is new.
+    // texture is the index of the material's texture map in the scene's texture
+    // list plus one, or 0 if it has none.
+    uint32_t indexOf(const SceneMaterial &material, uint32_t texture = 0);
+
+    void clear();
+
+    const std::vector<GpuMaterial> &materials() const { return m_materials; }
+
+private:
+    using Key = std::array<float, sizeof(GpuMaterial) / sizeof(float)>;
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    std::vector<GpuMaterial> m_materials;
+    std::unordered_map<Key, uint32_t, KeyHash> m_indices;
+};
+
+// Distance at which the light's attenuated intensity drops below LightCutoff,
+// or -1 if it never does (directional lights, or no distance falloff).
+float lightRange(const SceneLightData &light);
+
+// Fills lights from the scene, placing global lights (those with unbounded
+// range) first, and returns how many there are. The remaining lights are the
+// ones to cluster. Scenes without lights get a single white point light at
+// headlightPos, so they are still visible.
+uint32_t packLights(const RenderData &renderData, const glm::vec3 &headlightPos, std::vector<GpuLight> &lights);
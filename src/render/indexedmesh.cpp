@@ -0,0 +1,231 @@
+#include "indexedmesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Tuning constants from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr int CacheSize = 32;
+constexpr float CacheDecayPower = 1.5f;
+constexpr float LastTriScore = 0.75f;
+constexpr float ValenceBoostScale = 2.0f;
+constexpr float ValenceBoostPower = 0.5f;
+
+float vertexScore(int cachePosition, int remainingTriangles) {
+    if (remainingTriangles == 0) {
+        // No triangles left to draw, so this vertex is of no use anymore
+        return -1.f;
+    }
+
+    float score = 0.f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The vertex was used by the last triangle. It gets a fixed score so
+            // that the next triangle doesn't simply reuse the same edge every time.
+            score = LastTriScore;
+        }
+        else {
+            float scaler = 1.f / (CacheSize - 3);
+            score = std::pow(1.f - (cachePosition - 3) * scaler, CacheDecayPower);
+        }
+    }
+
+    // Bonus for vertices with few triangles left, so that lone triangles get drawn
+    score += ValenceBoostScale * std::pow((float)remainingTriangles, -ValenceBoostPower);
+    return score;
+}
+
+uint32_t hashVertex(const float *v, int n) {
+    // FNV-1a over the bit patterns of the attributes
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < n; i++) {
+        float f = v[i] + 0.f; // folds -0 into +0 so they hash identically
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        h = (h ^ bits) * 16777619u;
+    }
+    return h;
+}
+
+} // namespace
+
+IndexedMesh buildIndexedMesh(const float *data, int floatCount, int floatsPerVertex) {
+    IndexedMesh mesh;
+    mesh.floatsPerVertex = floatsPerVertex;
+
+    int inputVertexCount = floatCount / floatsPerVertex;
+    mesh.indices.reserve(inputVertexCount);
+    mesh.vertices.reserve(floatCount);
+
+    // Open-addressed table of (unique vertex index + 1); 0 marks an empty slot
+    size_t tableSize = 1;
+    while (tableSize < (size_t)inputVertexCount * 2) {
+        tableSize <<= 1;
+    }
+    std::vector<uint32_t> table(tableSize, 0);
+
+    for (int i = 0; i < inputVertexCount; i++) {
+        const float *vertex = data + i * floatsPerVertex;
+        size_t slot = hashVertex(vertex, floatsPerVertex) & (tableSize - 1);
+
+        while (true) {
+            if (table[slot] == 0) {
+                uint32_t index = (uint32_t)mesh.vertexCount();
+                mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + floatsPerVertex);
+                table[slot] = index + 1;
+                mesh.indices.push_back(index);
+                break;
+            }
+
+            const float *candidate = mesh.vertices.data() + (table[slot] - 1) * floatsPerVertex;
+            if (std::equal(vertex, vertex + floatsPerVertex, candidate)) {
+                mesh.indices.push_back(table[slot] - 1);
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+
+    optimizeVertexCache(mesh.indices, mesh.vertexCount());
+    optimizeVertexFetch(mesh);
+
+    return mesh;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Adjacency: for every vertex, the triangles that still need to be drawn
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScores[t] = vertexScores[indices[t * 3]] +
+                            vertexScores[indices[t * 3 + 1]] +
+                            vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+
+    // Simulated LRU cache, with room for the three vertices of the incoming triangle
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+    cache.reserve(CacheSize + 3);
+    nextCache.reserve(CacheSize + 3);
+
+    size_t scanCursor = 0;
+    long best = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+
+    while (best >= 0) {
+        const uint32_t *tri = &indices[best * 3];
+        emitted[best] = true;
+        output.insert(output.end(), tri, tri + 3);
+
+        // Remove the triangle from its vertices' remaining lists
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = tri[k];
+            uint32_t *begin = &adjacency[adjacencyOffset[v]];
+            uint32_t *end = begin + remaining[v];
+            *std::find(begin, end, (uint32_t)best) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // Move the triangle's vertices to the front of the cache
+        nextCache.assign(tri, tri + 3);
+        for (uint32_t v : cache) {
+            if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                nextCache.push_back(v);
+            }
+        }
+        std::swap(cache, nextCache);
+
+        // Rescore every vertex that is (or was just pushed out of) the cache
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t v = cache[i];
+            cachePosition[v] = i < (size_t)CacheSize ? (int)i : -1;
+            float score = vertexScore(cachePosition[v], remaining[v]);
+            float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+
+            for (uint32_t a = 0; a < remaining[v]; a++) {
+                triangleScores[adjacency[adjacencyOffset[v] + a]] += delta;
+            }
+        }
+        if (cache.size() > (size_t)CacheSize) {
+            cache.resize(CacheSize);
+        }
+
+        // The next triangle is the best scoring one touching the cache
+        best = -1;
+        float bestScore = -1.f;
+        for (uint32_t v : cache) {
+            for (uint32_t a = 0; a < remaining[v]; a++) {
+                uint32_t t = adjacency[adjacencyOffset[v] + a];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+
+        // Nothing left around the cache, so continue with any triangle not yet drawn
+        if (best < 0) {
+            while (scanCursor < triangleCount && emitted[scanCursor]) {
+                scanCursor++;
+            }
+            if (scanCursor < triangleCount) {
+                best = (long)scanCursor;
+            }
+        }
+    }
+
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(IndexedMesh &mesh) {
+    size_t vertexCount = mesh.vertexCount();
+    const uint32_t unassigned = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unassigned);
+    std::vector<float> vertices(mesh.vertices.size());
+
+    uint32_t next = 0;
+    for (uint32_t &index : mesh.indices) {
+        if (remap[index] == unassigned) {
+            std::copy_n(mesh.vertices.begin() + index * mesh.floatsPerVertex, mesh.floatsPerVertex,
+                        vertices.begin() + next * mesh.floatsPerVertex);
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+
+    // Vertices that no triangle references are dropped
+    vertices.resize(next * mesh.floatsPerVertex);
+    mesh.vertices.swap(vertices);
+}
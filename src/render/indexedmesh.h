@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Interleaved vertex data plus a triangle list indexing into it.
+struct IndexedMesh {
+    std::vector<float> vertices; // floatsPerVertex floats per vertex
+    std::vector<uint32_t> indices;
+    int floatsPerVertex = 6;
+
+    size_t vertexCount() const { return vertices.size() / floatsPerVertex; }
+};
+
+// Builds an indexed mesh from a non-indexed triangle soup. Vertices whose
+// attributes are identical are merged, the triangle order is optimized for the
+// post-transform vertex cache and vertices are renumbered in first-use order.
+// @param data             Interleaved vertex attributes, floatsPerVertex per vertex.
+// @param floatCount       Total number of floats in data.
+// @param floatsPerVertex  Number of floats making up one vertex.
+IndexedMesh buildIndexedMesh(const float *data, int floatCount, int floatsPerVertex = 6);
+
+// Reorders the triangles of an index list to improve post-transform vertex
+// cache hits, using Tom Forsyth's linear-speed vertex cache optimisation.
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+
+// Renumbers vertices in the order they are first referenced by the index list,
+// so vertex fetches walk through the vertex buffer linearly.
+void optimizeVertexFetch(IndexedMesh &mesh);
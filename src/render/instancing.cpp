@@ -0,0 +1,31 @@
+#include "instancing.h"
+
+void buildInstanceBatches(const ShapeTable &shapes, const RenderQueue &queue, std::vector<ShapeInstance> &instances,
+                          std::vector<DrawBatch> &batches) {
+    instances.resize(queue.size());
+    batches.clear();
+
+    for (int meshId = 0; meshId < queue.meshCount(); meshId++) {
+        size_t first = queue.meshBegin(meshId);
+        size_t last = queue.meshBegin(meshId + 1);
+        if (first == last) {
+            continue;
+        }
+        batches.push_back(DrawBatch{meshId, (uint32_t)first, (uint32_t)(last - first)});
+        for (size_t i = first; i < last; i++) {
+            uint32_t shape = queue.shape(i);
+            instances[i] = ShapeInstance{glm::transpose(shapes.ctm(shape)), (uint32_t)meshId, shapes.material(shape)};
+        }
+    }
+}
+
+void buildIndirectCommands(const std::vector<DrawBatch> &batches, const StaticMeshBuffer &meshBuffer,
+                           std::vector<DrawElementsIndirectCommand> &commands) {
+    commands.clear();
+    commands.reserve(batches.size());
+    for (const DrawBatch &batch : batches) {
+        const MeshRange &range = meshBuffer.range(batch.meshId);
+        commands.push_back(DrawElementsIndirectCommand{
+            range.indexCount, batch.instanceCount, range.firstIndex, 0, batch.firstInstance});
+    }
+}
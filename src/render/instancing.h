@@ -0,0 +1,45 @@
+#pragma once
+
+#include "parser/sceneparser.h"
+#include "meshbuffer.h"
+#include "renderqueue.h"
+#include "shapetable.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// Per-instance vertex attributes, streamed alongside the shared static geometry.
+struct ShapeInstance {
+    glm::mat3x4 modelRows; // The three rows of the shape's affine model matrix
+    uint32_t meshId;     // Selects the mesh's entry in the position decode table
+    uint32_t materialId; // Selects the shape's entry in the material table
+};
+
+// A run of consecutive instances which all draw the same mesh.
+struct DrawBatch {
+    int meshId;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// Layout of one command in a GL_DRAW_INDIRECT_BUFFER, as defined by the GL spec.
+struct DrawElementsIndirectCommand {
+    uint32_t count;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t baseInstance;
+};
+
+// Mesh id for every PrimitiveType, or -1 if that type has no geometry yet.
+using PrimitiveMeshTable = std::array<int, (size_t)PrimitiveType::PRIMITIVE_MESH + 1>;
+
+// Writes one instance per queued shape, in the queue's order, and one batch
+// per mesh the queue draws. The queue must be sorted.
+void buildInstanceBatches(const ShapeTable &shapes, const RenderQueue &queue, std::vector<ShapeInstance> &instances,
+                          std::vector<DrawBatch> &batches);
+
+// Converts batches into multi-draw-indirect commands for the given mesh buffer.
+void buildIndirectCommands(const std::vector<DrawBatch> &batches, const StaticMeshBuffer &meshBuffer,
+                           std::vector<DrawElementsIndirectCommand> &commands);
@@ -0,0 +1,148 @@
+#include "lightclusters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CLUSTERS_SSE
+#endif
+
+void LightClusterGrid::setProjection(float fovy, float aspect, float zNear, float zFar,
+                                     int tilesX, int tilesY, int slices) {
+    m_tilesX = tilesX;
+    m_tilesY = tilesY;
+    m_slices = slices;
+    m_sliceStride = (tilesX * tilesY + 3) & ~3;
+    m_zNear = zNear;
+    m_zFar = zFar;
+
+    float logRatio = std::log(zFar / zNear);
+    m_sliceScale = slices / logRatio;
+    m_sliceBias = -slices * std::log(zNear) / logRatio;
+
+    // Padding clusters sit far away from anything a light could reach
+    size_t count = (size_t)m_sliceStride * slices;
+    m_minX.assign(count, 1e30f);
+    m_minY.assign(count, 1e30f);
+    m_minZ.assign(count, 1e30f);
+    m_maxX.assign(count, 1e30f);
+    m_maxY.assign(count, 1e30f);
+    m_maxZ.assign(count, 1e30f);
+
+    float tanY = std::tan(fovy / 2.f);
+    float tanX = tanY * aspect;
+
+    for (int s = 0; s < slices; s++) {
+        float d0 = zNear * std::pow(zFar / zNear, (float)s / slices);
+        float d1 = zNear * std::pow(zFar / zNear, (float)(s + 1) / slices);
+
+        for (int y = 0; y < tilesY; y++) {
+            float ndcY0 = -1.f + 2.f * y / tilesY;
+            float ndcY1 = -1.f + 2.f * (y + 1) / tilesY;
+
+            for (int x = 0; x < tilesX; x++) {
+                float ndcX0 = -1.f + 2.f * x / tilesX;
+                float ndcX1 = -1.f + 2.f * (x + 1) / tilesX;
+
+                // The cluster is a frustum slab; bound its corners at both depths
+                size_t i = (size_t)s * m_sliceStride + y * tilesX + x;
+                m_minX[i] = std::min({ndcX0 * tanX * d0, ndcX0 * tanX * d1});
+                m_maxX[i] = std::max({ndcX1 * tanX * d0, ndcX1 * tanX * d1});
+                m_minY[i] = std::min({ndcY0 * tanY * d0, ndcY0 * tanY * d1});
+                m_maxY[i] = std::max({ndcY1 * tanY * d0, ndcY1 * tanY * d1});
+                m_minZ[i] = -d1;
+                m_maxZ[i] = -d0;
+            }
+        }
+    }
+}
+
+void LightClusterGrid::assign(const std::vector<GpuLight> &lights, uint32_t firstLight, const glm::mat4 &view) {
+    m_hitClusters.clear();
+    m_hitLights.clear();
+
+    for (uint32_t i = firstLight; i < lights.size(); i++) {
+        glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(lights[i].position), 1.f));
+        assignLight(i, center, lights[i].color.w);
+    }
+
+    // Counting sort of the hits by cluster, keeping lights in ascending order
+    size_t clusterCount = (size_t)m_tilesX * m_tilesY * m_slices;
+    m_clusters.assign(clusterCount, glm::uvec2(0));
+    for (uint32_t cluster : m_hitClusters) {
+        m_clusters[cluster].y++;
+    }
+    uint32_t offset = 0;
+    for (glm::uvec2 &cluster : m_clusters) {
+        cluster.x = offset;
+        offset += cluster.y;
+        cluster.y = 0;
+    }
+    m_lightIndices.resize(offset);
+    for (size_t h = 0; h < m_hitClusters.size(); h++) {
+        glm::uvec2 &cluster = m_clusters[m_hitClusters[h]];
+        m_lightIndices[cluster.x + cluster.y++] = m_hitLights[h];
+    }
+}
+
+void LightClusterGrid::assignLight(uint32_t light, const glm::vec3 &center, float radius) {
+    float depth = -center.z;
+    if (depth + radius < m_zNear || depth - radius > m_zFar) {
+        return;
+    }
+
+    // Only the slices the sphere's depth range overlaps need testing
+    auto slice = [&](float d) {
+        float s = std::log(std::max(d, m_zNear)) * m_sliceScale + m_sliceBias;
+        return std::clamp((int)std::floor(s), 0, m_slices - 1);
+    };
+    size_t begin = (size_t)slice(depth - radius) * m_sliceStride;
+    size_t end = (size_t)(slice(depth + radius) + 1) * m_sliceStride;
+    float radius2 = radius * radius;
+
+    int tilesPerSlice = m_tilesX * m_tilesY;
+    auto hit = [&](size_t i) {
+        size_t s = i / m_sliceStride;
+        size_t tile = i - s * m_sliceStride;
+        m_hitClusters.push_back((uint32_t)(s * tilesPerSlice + tile));
+        m_hitLights.push_back(light);
+    };
+
+#ifdef CLUSTERS_SSE
+    // Squared distance from the sphere center to four cluster boxes at a time
+    __m128 cx = _mm_set1_ps(center.x);
+    __m128 cy = _mm_set1_ps(center.y);
+    __m128 cz = _mm_set1_ps(center.z);
+    __m128 r2 = _mm_set1_ps(radius2);
+    __m128 zero = _mm_setzero_ps();
+
+    for (size_t i = begin; i < end; i += 4) {
+        __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[i]), cx), zero),
+                               _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&m_maxX[i])), zero));
+        __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[i]), cy), zero),
+                               _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&m_maxY[i])), zero));
+        __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[i]), cz), zero),
+                               _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&m_maxZ[i])), zero));
+        __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+        int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, r2));
+        if (mask != 0) {
+            for (int lane = 0; lane < 4; lane++) {
+                if (mask & (1 << lane)) {
+                    hit(i + lane);
+                }
+            }
+        }
+    }
+#else
+    for (size_t i = begin; i < end; i++) {
+        float dx = std::max(m_minX[i] - center.x, 0.f) + std::max(center.x - m_maxX[i], 0.f);
+        float dy = std::max(m_minY[i] - center.y, 0.f) + std::max(center.y - m_maxY[i], 0.f);
+        float dz = std::max(m_minZ[i] - center.z, 0.f) + std::max(center.z - m_maxZ[i], 0.f);
+        if (dx * dx + dy * dy + dz * dz <= radius2) {
+            hit(i);
+        }
+    }
+#endif
+}
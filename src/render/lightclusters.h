@@ -0,0 +1,61 @@
+#pragma once
+
+#include "gpuscene.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Assigns point and spot lights to the clusters of a view frustum split into
+// screen tiles and exponentially spaced depth slices, so that each fragment
+// only evaluates the lights whose range overlaps its cluster.
+//
+// Clusters are numbered (slice * tilesY + tileY) * tilesX + tileX, with tile
+// (0, 0) in the bottom left corner of the viewport, matching gl_FragCoord.
+class LightClusterGrid {
+public:
+    // Rebuilds the view-space bounds of every cluster. Must be called whenever
+    // the projection changes.
+    void setProjection(float fovy, float aspect, float zNear, float zFar,
+                       int tilesX = 16, int tilesY = 9, int slices = 24);
+
+    // Assigns lights[firstLight..] to the clusters they overlap. Lights are in
+    // world space, with their range in color.w; view takes them to view space.
+    void assign(const std::vector<GpuLight> &lights, uint32_t firstLight, const glm::mat4 &view);
+
+    // (offset, count) into lightIndices() for every cluster.
+    const std::vector<glm::uvec2> &clusters() const { return m_clusters; }
+    const std::vector<uint32_t> &lightIndices() const { return m_lightIndices; }
+
+    int tilesX() const { return m_tilesX; }
+    int tilesY() const { return m_tilesY; }
+    int slices() const { return m_slices; }
+
+    // Maps a view-space depth d to slice log(d) * sliceScale + sliceBias.
+    float sliceScale() const { return m_sliceScale; }
+    float sliceBias() const { return m_sliceBias; }
+
+private:
+    void assignLight(uint32_t light, const glm::vec3 &center, float radius);
+
+    int m_tilesX = 0;
+    int m_tilesY = 0;
+    int m_slices = 0;
+    int m_sliceStride = 0; // Tiles per slice, padded to a multiple of 4
+    float m_zNear = 0.f;
+    float m_zFar = 0.f;
+    float m_sliceScale = 0.f;
+    float m_sliceBias = 0.f;
+
+    // View-space cluster bounds, structure-of-arrays for 4-wide tests
+    std::vector<float> m_minX, m_minY, m_minZ;
+    std::vector<float> m_maxX, m_maxY, m_maxZ;
+
+    // (cluster, light) pairs found by the overlap tests
+    std::vector<uint32_t> m_hitClusters;
+    std::vector<uint32_t> m_hitLights;
+
+    std::vector<glm::uvec2> m_clusters;
+    std::vector<uint32_t> m_lightIndices;
+};
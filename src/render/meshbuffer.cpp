@@ -0,0 +1,64 @@
+#include "meshbuffer.h"
+
+#include <cassert>
+
+int StaticMeshBuffer::addMesh(const IndexedMesh &mesh, UvMapping uvMapping) {
+    assert(mesh.floatsPerVertex == 6);
+
+    int stride = vertexStride(m_format);
+
+    MeshRange range;
+    range.firstIndex = (uint32_t)m_indices.size();
+    range.indexCount = (uint32_t)mesh.indices.size();
+    range.firstVertex = (uint32_t)(m_vertexData.size() / stride);
+    range.vertexCount = (uint32_t)mesh.vertexCount();
+
+    MeshBounds bounds = computeMeshBounds(mesh);
+
+    if (m_format == VertexFormat::VERTEX_COMPACT) {
+        std::vector<CompactVertex> packed = packCompactVertices(mesh, bounds);
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(packed.data());
+        m_vertexData.insert(m_vertexData.end(), bytes, bytes + packed.size() * sizeof(CompactVertex));
+    }
+    else {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(mesh.vertices.data());
+        m_vertexData.insert(m_vertexData.end(), bytes, bytes + mesh.vertices.size() * sizeof(float));
+    }
+
+    m_indices.reserve(m_indices.size() + mesh.indices.size());
+    for (uint32_t index : mesh.indices) {
+        m_indices.push_back(index + range.firstVertex);
+    }
+
+    m_ranges.push_back(range);
+    m_bounds.push_back(bounds);
+    m_uvMappings.push_back(uvMapping);
+    return (int)m_ranges.size() - 1;
+}
+
+void StaticMeshBuffer::clear(VertexFormat format) {
+    m_format = format;
+    m_vertexData.clear();
+    m_indices.clear();
+    m_ranges.clear();
+    m_bounds.clear();
+    m_uvMappings.clear();
+}
+
+std::vector<glm::vec4> StaticMeshBuffer::decodeTable() const {
+    std::vector<glm::vec4> table;
+    table.reserve(m_bounds.size() * 2);
+    for (size_t i = 0; i < m_bounds.size(); i++) {
+        float uvMapping = (float)m_uvMappings[i];
+        if (m_format == VertexFormat::VERTEX_COMPACT) {
+            table.push_back(glm::vec4(m_bounds[i].min, uvMapping));
+            table.push_back(glm::vec4(m_bounds[i].extent, 0.f));
+        }
+        else {
+            // Float positions are stored as-is
+            table.push_back(glm::vec4(0.f, 0.f, 0.f, uvMapping));
+            table.push_back(glm::vec4(1.f, 1.f, 1.f, 0.f));
+        }
+    }
+    return table;
+}
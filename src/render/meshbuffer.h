@@ -0,0 +1,62 @@
+#pragma once
+
+#include "indexedmesh.h"
+#include "vertexformat.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Location of a single mesh inside a StaticMeshBuffer.
+struct MeshRange {
+    uint32_t firstIndex;  // Offset of the mesh's first index, in indices
+    uint32_t indexCount;
+    uint32_t firstVertex; // Offset of the mesh's first vertex, in vertices
+    uint32_t vertexCount;
+};
+
+// How texture coordinates are derived from object-space positions, per mesh.
+enum class UvMapping {
+    UV_NONE,
+    UV_CUBE,     // Per face, from the dominant normal axis
+    UV_SPHERE,   // Longitude/latitude
+    UV_CYLINDER  // Longitude/height on the side, per face on the caps; also used for cones
+};
+
+// Packs any number of indexed meshes into one shared vertex buffer and one
+// shared index buffer, so that all static geometry can be drawn through a
+// single vertex array object. Indices are stored relative to the start of the
+// shared vertex buffer, so draws need no base vertex.
+class StaticMeshBuffer {
+public:
+    explicit StaticMeshBuffer(VertexFormat format = VertexFormat::VERTEX_FLOAT) : m_format(format) {}
+
+    // Appends a position/normal mesh, converting it to the buffer's vertex format,
+    // and returns its id, which indexes the offset table.
+    int addMesh(const IndexedMesh &mesh, UvMapping uvMapping = UvMapping::UV_NONE);
+
+    // Removes all meshes and switches to the given vertex format.
+    void clear(VertexFormat format);
+
+    VertexFormat format() const { return m_format; }
+    const std::vector<uint8_t> &vertexData() const { return m_vertexData; }
+    const std::vector<uint32_t> &indices() const { return m_indices; }
+
+    const MeshRange &range(int meshId) const { return m_ranges[meshId]; }
+    const MeshBounds &bounds(int meshId) const { return m_bounds[meshId]; }
+    int meshCount() const { return (int)m_ranges.size(); }
+
+    // Two texels per mesh, (offset, uv mapping) and (scale, 0), which map the
+    // stored positions back to object space as offset + position * scale.
+    std::vector<glm::vec4> decodeTable() const;
+
+private:
+    VertexFormat m_format;
+
+    std::vector<uint8_t> m_vertexData;
+    std::vector<uint32_t> m_indices;
+    std::vector<MeshRange> m_ranges;
+    std::vector<MeshBounds> m_bounds;
+    std::vector<UvMapping> m_uvMappings;
+};
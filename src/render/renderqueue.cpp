@@ -0,0 +1,126 @@
+#include "renderqueue.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr int KeyBits = 32;
+constexpr int DigitBits = 11;
+
+// Early depth rejection only needs a coarse near-to-far order, so the depth
+// takes what the fewest digits holding the mesh and this many depth bits
+// leave over. With a handful of meshes that is one digit and one pass
+constexpr int MinDepthBits = 7;
+constexpr int MaxDepthBits = 16;
+
+constexpr int MaxDigits = (KeyBits + DigitBits - 1) / DigitBits;
+constexpr int Buckets = 1 << DigitBits;
+
+// Growing only, so frames queueing fewer shapes do not clear the arrays again
+void growTo(std::vector<uint32_t> &array, size_t size) {
+    if (array.size() < size) {
+        array.resize(size);
+    }
+}
+
+} // namespace
+
+void RenderQueue::build(const ShapeTable &shapes, const Frustum &frustum, const glm::mat4 &view, float farDepth,
+                        int meshCount) {
+    int meshBits = std::max(1, (int)std::bit_width((unsigned)std::max(meshCount - 1, 0)));
+    int digits = (meshBits + MinDepthBits + DigitBits - 1) / DigitBits;
+    int depthBits = std::clamp(std::min(digits * DigitBits, KeyBits - ProgramBits) - meshBits, 0, MaxDepthBits);
+    // The program field stays 0 while every shape draws with the same program
+    m_digits = (meshBits + depthBits + DigitBits - 1) / DigitBits;
+
+    // Sorting swaps them with the scratch arrays, so they are sized apart
+    growTo(m_keys, shapes.size());
+    growTo(m_shapes, shapes.size());
+    m_histograms.assign(MaxDigits * Buckets, 0);
+    m_meshBegins.assign(std::max(meshCount, 0) + 1, 0);
+    m_projectiveShapes.clear();
+    m_count = 0;
+    m_culled = 0;
+
+    // Distance in front of the camera of each bounds center
+    glm::vec3 forward(-view[0][2], -view[1][2], -view[2][2]);
+    float eyeDepth = -view[3][2];
+    float maxDepth = (float)((1u << depthBits) - 1);
+    float depthScale = farDepth > 0.f ? maxDepth / farDepth : 0.f;
+    for (size_t i = 0; i < shapes.size(); i++) {
+        int meshId = shapes.meshId(i);
+        if (meshId < 0) {
+            continue;
+        }
+        if (shapes.projective(i)) {
+            m_projectiveShapes.push_back(i);
+            continue;
+        }
+        const glm::vec3 &center = shapes.center(i);
+        if (!frustum.intersects(center, shapes.halfExtent(i))) {
+            m_culled++;
+            continue;
+        }
+
+        float depth = std::clamp((glm::dot(forward, center) + eyeDepth) * depthScale, 0.f, maxDepth);
+        uint32_t key = ((uint32_t)meshId << depthBits) | (uint32_t)depth;
+        m_keys[m_count] = key;
+        m_shapes[m_count] = i;
+        m_count++;
+        m_meshBegins[meshId + 1]++;
+        for (int d = 0; d < m_digits; d++) {
+            m_histograms[d * Buckets + ((key >> (d * DigitBits)) & (Buckets - 1))]++;
+        }
+    }
+    for (size_t m = 1; m < m_meshBegins.size(); m++) {
+        m_meshBegins[m] += m_meshBegins[m - 1];
+    }
+}
+
+void RenderQueue::sort() {
+    if (m_count < 2) {
+        return;
+    }
+    growTo(m_keyScratch, m_count);
+    growTo(m_shapeScratch, m_count);
+
+    // Least significant digit first, skipping digits all keys share
+    auto shared = [&](int d) {
+        return m_histograms[d * Buckets + ((m_keys[0] >> (d * DigitBits)) & (Buckets - 1))] == m_count;
+    };
+    int lastDigit = m_digits - 1;
+    while (lastDigit >= 0 && shared(lastDigit)) {
+        lastDigit--;
+    }
+    for (int d = 0; d <= lastDigit; d++) {
+        if (shared(d)) {
+            continue;
+        }
+        uint32_t *histogram = &m_histograms[d * Buckets];
+        int shift = d * DigitBits;
+
+        uint32_t offset = 0;
+        for (int b = 0; b < Buckets; b++) {
+            uint32_t bucket = histogram[b];
+            histogram[b] = offset;
+            offset += bucket;
+        }
+        // The keys are not needed after the last pass
+        if (d < lastDigit) {
+            for (size_t k = 0; k < m_count; k++) {
+                uint32_t key = m_keys[k];
+                uint32_t slot = histogram[(key >> shift) & (Buckets - 1)]++;
+                m_keyScratch[slot] = key;
+                m_shapeScratch[slot] = m_shapes[k];
+            }
+            m_keys.swap(m_keyScratch);
+        }
+        else {
+            for (size_t k = 0; k < m_count; k++) {
+                m_shapeScratch[histogram[(m_keys[k] >> shift) & (Buckets - 1)]++] = m_shapes[k];
+            }
+        }
+        m_shapes.swap(m_shapeScratch);
+    }
+}
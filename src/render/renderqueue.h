@@ -0,0 +1,55 @@
+#pragma once
+
+#include "frustum.h"
+#include "shapetable.h"
+
+#include <cstdint>
+#include <vector>
+
+// The visible shapes in draw order, as one 32-bit key per draw with the
+// shape's index carried alongside. From the most significant bits down a key
+// holds the shader program, the mesh and the view depth of the shape's
+// bounds, so sorting the keys groups draws that share GL state and puts each
+// group in near-to-far order for early depth rejection. Materials are looked
+// up per instance and cost no state change, so they are not part of the key.
+class RenderQueue {
+public:
+    static constexpr int ProgramBits = 4;
+
+    // Queues every shape with a mesh whose bounds intersect frustum, in one
+    // pass over the table. Shapes with a projective CTM have no bounds, so
+    // they are listed in projectiveShapes instead. view is the camera's view
+    // matrix, and depths are quantized over [0, farDepth]; meshCount bounds
+    // the shapes' mesh ids.
+    void build(const ShapeTable &shapes, const Frustum &frustum, const glm::mat4 &view, float farDepth, int meshCount);
+
+    // Radix sorts the keys, keeping shape order among equal keys. The last
+    // pass only moves the shapes, as the mesh ranges are known from build.
+    void sort();
+
+    size_t size() const { return m_count; }
+    uint32_t shape(size_t i) const { return m_shapes[i]; }
+
+    // Once sorted, the shapes drawing mesh meshId are [meshBegin(meshId),
+    // meshBegin(meshId + 1)), for mesh ids below meshCount.
+    int meshCount() const { return (int)m_meshBegins.size() - 1; }
+    size_t meshBegin(int meshId) const { return m_meshBegins[meshId]; }
+
+    // Shapes left out of the queue by the frustum, and the projective ones
+    size_t culled() const { return m_culled; }
+    const std::vector<uint32_t> &projectiveShapes() const { return m_projectiveShapes; }
+
+private:
+    std::vector<uint32_t> m_keys;
+    std::vector<uint32_t> m_shapes;
+    std::vector<uint32_t> m_keyScratch;
+    std::vector<uint32_t> m_shapeScratch;
+    size_t m_count = 0;
+    size_t m_culled = 0;
+    std::vector<uint32_t> m_projectiveShapes;
+
+    // Histograms of each digit of the keys, counted while building them
+    std::vector<uint32_t> m_histograms;
+    int m_digits = 0;
+    std::vector<uint32_t> m_meshBegins;
+};
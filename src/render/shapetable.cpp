@@ -0,0 +1,45 @@
+#include "shapetable.h"
+#include "render/frustum.h"
+
+namespace {
+
+template <typename Array>
+void replaceRange(Array &array, size_t first, size_t last, size_t count) {
+    array.erase(array.begin() + first, array.begin() + last);
+    array.insert(array.begin() + first, count, typename Array::value_type{});
+}
+
+} // namespace
+
+void ShapeTable::resize(size_t count) {
+    m_ctms.resize(count);
+    m_meshIds.resize(count, -1);
+    m_materials.resize(count);
+    m_projective.resize(count);
+    m_centers.resize(count);
+    m_halfExtents.resize(count);
+}
+
+void ShapeTable::replace(size_t first, size_t last, size_t count) {
+    replaceRange(m_ctms, first, last, count);
+    replaceRange(m_materials, first, last, count);
+    replaceRange(m_projective, first, last, count);
+    replaceRange(m_centers, first, last, count);
+    replaceRange(m_halfExtents, first, last, count);
+    m_meshIds.erase(m_meshIds.begin() + first, m_meshIds.begin() + last);
+    m_meshIds.insert(m_meshIds.begin() + first, count, -1);
+}
+
+void ShapeTable::set(size_t i, const RenderShapeData &shape, int meshId, const MeshBounds &bounds, uint32_t material) {
+    m_ctms[i] = affineFromMat4(shape.ctm);
+    m_meshIds[i] = meshId;
+    m_materials[i] = material;
+    m_projective[i] = !isAffine(shape.ctm);
+    if (meshId >= 0 && !m_projective[i]) {
+        transformBounds(m_ctms[i], bounds, m_centers[i], m_halfExtents[i]);
+    }
+    else {
+        m_centers[i] = glm::vec3(0.f);
+        m_halfExtents[i] = glm::vec3(0.f);
+    }
+}
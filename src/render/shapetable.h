@@ -0,0 +1,66 @@
+#pragma once
+
+#include "parser/affine.h"
+#include "parser/sceneparser.h"
+#include "render/vertexformat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// Allocates arrays starting on a cache line.
+template <typename T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+    static constexpr std::align_val_t Alignment{64};
+
+    CacheAlignedAllocator() = default;
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T *allocate(size_t count) { return static_cast<T *>(::operator new(count * sizeof(T), Alignment)); }
+    void deallocate(T *data, size_t) { ::operator delete(data, Alignment); }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U> &) const { return true; }
+};
+
+// The fields of the scene's shapes which culling and batching read every
+// frame, each in an array of its own, so those loops only pull in the data
+// they use. The RenderShapeData the table is built from hold the cold
+// payload: materials, texture and mesh file names. Entry i is shape i.
+class ShapeTable {
+public:
+    size_t size() const { return m_meshIds.size(); }
+    void resize(size_t count);
+
+    // Replaces entries [first, last) with count cleared ones, shifting those after.
+    void replace(size_t first, size_t last, size_t count);
+
+    // Fills entry i. meshId is the mesh drawing the shape, or -1 if none
+    // does, and bounds that mesh's object-space bounds. A shape with a
+    // projective CTM is flagged instead of bounded; its CTM is kept in full
+    // by the RenderShapeData only.
+    void set(size_t i, const RenderShapeData &shape, int meshId, const MeshBounds &bounds, uint32_t material);
+
+    const glm::mat4x3 &ctm(size_t i) const { return m_ctms[i]; }
+    bool projective(size_t i) const { return m_projective[i] != 0; }
+    int meshId(size_t i) const { return m_meshIds[i]; }
+    uint32_t material(size_t i) const { return m_materials[i]; }
+
+    // World-space bounding box, for culling
+    const glm::vec3 &center(size_t i) const { return m_centers[i]; }
+    const glm::vec3 &halfExtent(size_t i) const { return m_halfExtents[i]; }
+
+private:
+    template <typename T>
+    using Array = std::vector<T, CacheAlignedAllocator<T>>;
+
+    Array<glm::mat4x3> m_ctms;
+    Array<int32_t> m_meshIds;
+    Array<uint32_t> m_materials;
+    Array<uint8_t> m_projective;
+    Array<glm::vec3> m_centers;
+    Array<glm::vec3> m_halfExtents;
+};
@@ -0,0 +1,111 @@
+#include "texturearrays.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Layers allocated for an array the first time it is used
+static const int InitialLayers = 8;
+
+void TextureArrays::create(QOpenGLFunctions_4_1_Core *gl) {
+    m_gl = gl;
+    m_gl->glGenTextures(MaxArrays, m_textures.data());
+    m_gl->glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &m_maxLayers);
+}
+
+void TextureArrays::destroy() {
+    if (m_gl != nullptr) {
+        m_gl->glDeleteTextures(MaxArrays, m_textures.data());
+        m_textures.fill(0);
+    }
+    m_arrays.clear();
+}
+
+void TextureArrays::clear() {
+    // The storage is reallocated when an array is first used again
+    m_arrays.clear();
+}
+
+glm::ivec2 TextureArrays::arraySize(glm::ivec2 size) const {
+    for (const Array &array : m_arrays) {
+        if (array.size == size) {
+            return size;
+        }
+    }
+    return (int)m_arrays.size() < MaxArrays ? size : m_arrays.front().size;
+}
+
+TextureLayer TextureArrays::add(const std::shared_ptr<const MipChain> &mips) {
+    glm::ivec2 size(mips->front().width(), mips->front().height());
+    auto it = std::find_if(m_arrays.begin(), m_arrays.end(), [&](const Array &array) { return array.size == size; });
+    if (it == m_arrays.end()) {
+        if ((int)m_arrays.size() == MaxArrays) {
+            std::cout << "texture of size " << size.x << "x" << size.y << " does not fit any texture array" << std::endl;
+            return TextureLayer{};
+        }
+        m_arrays.push_back(Array{size, 0, {}});
+        it = m_arrays.end() - 1;
+    }
+
+    size_t index = it - m_arrays.begin();
+    Array &array = *it;
+    if ((int)array.layers.size() == m_maxLayers) {
+        std::cout << "too many textures of size " << size.x << "x" << size.y << ", some are not drawn" << std::endl;
+        return TextureLayer{};
+    }
+
+    int layer = (int)array.layers.size();
+    array.layers.push_back(mips);
+    if (layer < array.capacity) {
+        m_gl->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textures[index]);
+        upload(index, layer);
+        m_gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+    else {
+        // Growing reallocates the storage, so every layer is uploaded again
+        allocate(index, std::min(std::max(InitialLayers, array.capacity * 2), (int)m_maxLayers));
+    }
+    return TextureLayer{(int)index, layer};
+}
+
+void TextureArrays::allocate(size_t index, int capacity) {
+    Array &array = m_arrays[index];
+    array.capacity = capacity;
+    m_gl->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textures[index]);
+
+    int levels = 0;
+    for (glm::ivec2 level = array.size; ; level = glm::max(level / 2, glm::ivec2(1))) {
+        m_gl->glTexImage3D(GL_TEXTURE_2D_ARRAY, levels++, GL_RGBA8, level.x, level.y, capacity, 0,
+                           GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        if (level == glm::ivec2(1)) {
+            break;
+        }
+    }
+    m_gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    m_gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    m_gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    m_gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    m_gl->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    for (int layer = 0; layer < (int)array.layers.size(); layer++) {
+        upload(index, layer);
+    }
+    m_gl->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// Expects the array to be bound
+void TextureArrays::upload(size_t index, int layer) {
+    const MipChain &mips = *m_arrays[index].layers[layer];
+    m_gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < (int)mips.size(); level++) {
+        const QImage &mip = mips[level];
+        m_gl->glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, mip.width(), mip.height(), 1,
+                              GL_RGBA, GL_UNSIGNED_BYTE, mip.constBits());
+    }
+}
+
+void TextureArrays::bind(GLuint firstUnit) const {
+    for (int i = 0; i < MaxArrays; i++) {
+        m_gl->glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+        m_gl->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textures[i]);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "render/texturemanager.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <QOpenGLFunctions_4_1_Core>
+#include <glm/glm.hpp>
+
+// Where a texture lives within TextureArrays.
+struct TextureLayer {
+    int array = -1; // -1 if the texture is not resident
+    int layer = 0;
+};
+
+// The textures of a scene packed into a few GL_TEXTURE_2D_ARRAYs, so that
+// shapes with different textures can still be drawn in one instanced call,
+// each material selecting its array and layer. Textures are added one at a
+// time as they finish decoding; only the new layer is uploaded, unless its
+// array has to grow.
+class TextureArrays {
+public:
+    // Number of sampler2DArray units the shaders declare
+    static constexpr int MaxArrays = 4;
+
+    // Requires a current context.
+    void create(QOpenGLFunctions_4_1_Core *gl);
+    void destroy();
+
+    // Forgets every texture added so far.
+    void clear();
+
+    // Size of the array a texture of the given size goes into: one of its
+    // own size, which is created while fewer than MaxArrays exist, or else
+    // the first array, which the texture must be resampled to fit.
+    glm::ivec2 arraySize(glm::ivec2 size) const;
+
+    // Uploads a mip chain, bottom row first, into a free layer of the array
+    // of its size, creating that array or doubling its layer count if
+    // needed. The chain's size must be an arraySize. Returns an array of -1
+    // if the array already holds as many layers as GL allows.
+    TextureLayer add(const std::shared_ptr<const MipChain> &mips);
+
+    // Binds array i to texture unit firstUnit + i.
+    void bind(GLuint firstUnit) const;
+
+private:
+    struct Array {
+        glm::ivec2 size = glm::ivec2(0);
+        int capacity = 0;
+        // Kept to re-upload the layers when the array grows
+        std::vector<std::shared_ptr<const MipChain>> layers;
+    };
+
+    void allocate(size_t index, int capacity);
+    void upload(size_t index, int layer);
+
+    QOpenGLFunctions_4_1_Core *m_gl = nullptr;
+    std::array<GLuint, MaxArrays> m_textures{};
+    std::vector<Array> m_arrays;
+    GLint m_maxLayers = 256;
+};
@@ -0,0 +1,45 @@
+#include "texturebuffer.h"
+
+#include <vector>
+
+void TextureBuffer::create(QOpenGLFunctions_4_1_Core *gl, GLenum internalFormat) {
+    m_gl = gl;
+    m_internalFormat = internalFormat;
+
+    m_gl->glGenBuffers(1, &m_buffer);
+    m_gl->glGenTextures(1, &m_texture);
+    upload(nullptr, 0);
+}
+
+void TextureBuffer::destroy() {
+    if (!isCreated()) {
+        return;
+    }
+    m_gl->glDeleteTextures(1, &m_texture);
+    m_gl->glDeleteBuffers(1, &m_buffer);
+    m_texture = 0;
+    m_buffer = 0;
+}
+
+void TextureBuffer::upload(const void *data, size_t bytes) {
+    // Never leave the buffer empty, so the texture always has a valid data store
+    std::vector<char> empty;
+    if (bytes == 0) {
+        empty.resize(16, 0);
+        data = empty.data();
+        bytes = empty.size();
+    }
+
+    m_gl->glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+    m_gl->glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_DYNAMIC_DRAW);
+    m_gl->glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+    m_gl->glTexBuffer(GL_TEXTURE_BUFFER, m_internalFormat, m_buffer);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void TextureBuffer::bind(GLuint unit) const {
+    m_gl->glActiveTexture(GL_TEXTURE0 + unit);
+    m_gl->glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+}
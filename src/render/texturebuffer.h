@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QOpenGLFunctions_4_1_Core>
+
+// A buffer object exposed to shaders as a samplerBuffer, read with texelFetch.
+// Used for per-mesh and per-material tables that instanced draws index into.
+class TextureBuffer {
+public:
+    // Creates the buffer and texture; requires a current context.
+    void create(QOpenGLFunctions_4_1_Core *gl, GLenum internalFormat);
+    void destroy();
+
+    // Replaces the contents of the buffer.
+    void upload(const void *data, size_t bytes);
+
+    // Binds the texture to the given texture unit.
+    void bind(GLuint unit) const;
+
+    bool isCreated() const { return m_texture != 0; }
+
+private:
+    QOpenGLFunctions_4_1_Core *m_gl = nullptr;
+    GLenum m_internalFormat = 0;
+    GLuint m_buffer = 0;
+    GLuint m_texture = 0;
+};
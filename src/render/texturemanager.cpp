@@ -0,0 +1,136 @@
+#include "texturemanager.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <QMutexLocker>
+
+TextureManager::TextureManager(QObject *parent) : QObject(parent) {
+}
+
+TextureManager::~TextureManager() {
+    // Workers hold their entry alive, but they still signal this object
+    m_pool.waitForDone();
+}
+
+void TextureManager::request(const std::string &path) {
+    std::shared_ptr<Entry> entry;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (m_entries.contains(path)) {
+            return;
+        }
+        entry = std::make_shared<Entry>();
+        m_entries[path] = entry;
+    }
+
+    m_pool.start([this, path, entry]() {
+        QImage image(QString::fromStdString(path));
+        std::shared_ptr<const MipChain> mips;
+        if (image.isNull()) {
+            std::cout << "could not load texture " << path << std::endl;
+        }
+        else {
+            mips = std::make_shared<const MipChain>(buildMipChain(image));
+        }
+
+        {
+            QMutexLocker lock(&m_mutex);
+            entry->mips = std::move(mips);
+            entry->state = entry->mips ? State::Decoded : State::Failed;
+        }
+        emit textureDecoded();
+    });
+}
+
+void TextureManager::reload(const std::string &path) {
+    {
+        // A worker still decoding the old file keeps its own entry alive
+        QMutexLocker lock(&m_mutex);
+        m_entries.erase(path);
+    }
+    request(path);
+}
+
+std::shared_ptr<const MipChain> TextureManager::mipChain(const std::string &path) {
+    QMutexLocker lock(&m_mutex);
+    auto it = m_entries.find(path);
+    if (it == m_entries.end() || it->second->state != State::Decoded) {
+        return nullptr;
+    }
+    return it->second->mips;
+}
+
+std::shared_ptr<const MipChain> TextureManager::resampledMipChain(const std::string &path, QSize size) {
+    std::shared_ptr<Entry> entry;
+    std::shared_ptr<const MipChain> source;
+    std::pair<int, int> key(size.width(), size.height());
+    {
+        QMutexLocker lock(&m_mutex);
+        auto it = m_entries.find(path);
+        if (it == m_entries.end() || it->second->state != State::Decoded) {
+            return nullptr;
+        }
+        entry = it->second;
+        if (entry->mips->front().size() == size) {
+            return entry->mips;
+        }
+        auto resampled = entry->resampled.find(key);
+        if (resampled != entry->resampled.end()) {
+            return resampled->second;
+        }
+        entry->resampled[key] = nullptr;
+        source = entry->mips;
+    }
+
+    // The source is already bottom row first
+    m_pool.start([this, entry, source, size, key]() {
+        auto mips = std::make_shared<const MipChain>(
+            buildMipChain(source->front().scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation), false));
+        {
+            QMutexLocker lock(&m_mutex);
+            entry->resampled[key] = std::move(mips);
+        }
+        emit textureDecoded();
+    });
+    return nullptr;
+}
+
+void TextureManager::waitForDone() {
+    m_pool.waitForDone();
+}
+
+void TextureManager::clear() {
+    // Workers still decoding keep their own entry alive
+    QMutexLocker lock(&m_mutex);
+    m_entries.clear();
+}
+
+MipChain TextureManager::buildMipChain(const QImage &image, bool flip) {
+    MipChain mips;
+    mips.push_back(image.convertToFormat(QImage::Format_RGBA8888).mirrored(false, flip));
+
+    while (mips.back().width() > 1 || mips.back().height() > 1) {
+        const QImage &src = mips.back();
+        int w = std::max(1, src.width() / 2);
+        int h = std::max(1, src.height() / 2);
+        QImage dst(w, h, QImage::Format_RGBA8888);
+
+        for (int y = 0; y < h; y++) {
+            // Odd sizes clamp to the last row/column of the source
+            const uchar *row0 = src.constScanLine(std::min(2 * y, src.height() - 1));
+            const uchar *row1 = src.constScanLine(std::min(2 * y + 1, src.height() - 1));
+            uchar *out = dst.scanLine(y);
+
+            for (int x = 0; x < w; x++) {
+                int x0 = std::min(2 * x, src.width() - 1) * 4;
+                int x1 = std::min(2 * x + 1, src.width() - 1) * 4;
+                for (int c = 0; c < 4; c++) {
+                    out[x * 4 + c] = (uchar)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+                }
+            }
+        }
+        mips.push_back(std::move(dst));
+    }
+    return mips;
+}
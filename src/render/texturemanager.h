@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <QImage>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+
+// A decoded image, full size level first.
+using MipChain = std::vector<QImage>;
+
+// Loads the image files referenced by scene materials. Each distinct path is
+// decoded once, on a worker pool, into a full mip chain; GL textures are built
+// from the chains by TextureArrays.
+class TextureManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TextureManager(QObject *parent = nullptr);
+    ~TextureManager();
+
+    // Starts decoding the image at path in the background, unless it has
+    // already been requested.
+    void request(const std::string &path);
+
+    // Drops the decoded image of path and decodes the file again.
+    void reload(const std::string &path);
+
+    // Returns the mip chain of path, or nullptr while it is still decoding or
+    // if it failed to load.
+    std::shared_ptr<const MipChain> mipChain(const std::string &path);
+
+    // Returns the mip chain of path resampled to size. The first call for a
+    // size starts resampling on the worker pool, emitting textureDecoded when
+    // done; until then, or if path failed to load, it returns nullptr.
+    std::shared_ptr<const MipChain> resampledMipChain(const std::string &path, QSize size);
+
+    // Blocks until every requested image has finished decoding.
+    void waitForDone();
+
+    // Forgets every decoded image.
+    void clear();
+
+    // Builds the mip chain of an image with a 2x2 box filter, from the full
+    // size level down to 1x1. Levels are RGBA8888; unless flip is false, the
+    // rows are also reordered bottom row first, as GL expects.
+    static MipChain buildMipChain(const QImage &image, bool flip = true);
+
+signals:
+    // Emitted from a worker thread whenever an image finishes decoding.
+    void textureDecoded();
+
+private:
+    enum class State {
+        Decoding,
+        Decoded,
+        Failed
+    };
+
+    struct Entry {
+        State state = State::Decoding;
+        std::shared_ptr<const MipChain> mips;
+        // By size; null while still resampling
+        std::map<std::pair<int, int>, std::shared_ptr<const MipChain>> resampled;
+    };
+
+    QThreadPool m_pool;
+    QMutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> m_entries;
+};
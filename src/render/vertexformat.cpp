@@ -0,0 +1,46 @@
+#include "vertexformat.h"
+
+#include <cstring>
+
+#include <glm/gtc/packing.hpp>
+
+int vertexStride(VertexFormat format) {
+    switch (format) {
+    case VertexFormat::VERTEX_COMPACT:
+        return sizeof(CompactVertex);
+    default:
+        return 6 * sizeof(float);
+    }
+}
+
+MeshBounds computeMeshBounds(const IndexedMesh &mesh) {
+    if (mesh.vertexCount() == 0) {
+        return MeshBounds{glm::vec3(0.f), glm::vec3(0.f)};
+    }
+
+    glm::vec3 lo(mesh.vertices[0], mesh.vertices[1], mesh.vertices[2]);
+    glm::vec3 hi = lo;
+    for (size_t v = 1; v < mesh.vertexCount(); v++) {
+        const float *p = &mesh.vertices[v * mesh.floatsPerVertex];
+        lo = glm::min(lo, glm::vec3(p[0], p[1], p[2]));
+        hi = glm::max(hi, glm::vec3(p[0], p[1], p[2]));
+    }
+    return MeshBounds{lo, hi - lo};
+}
+
+std::vector<CompactVertex> packCompactVertices(const IndexedMesh &mesh, const MeshBounds &bounds) {
+    // Flat axes have no extent to normalize against; everything maps to 0 there
+    glm::vec3 invExtent = glm::vec3(1.f) / glm::max(bounds.extent, glm::vec3(1e-20f));
+
+    std::vector<CompactVertex> packed(mesh.vertexCount());
+    for (size_t v = 0; v < packed.size(); v++) {
+        const float *p = &mesh.vertices[v * mesh.floatsPerVertex];
+        glm::vec3 position = (glm::vec3(p[0], p[1], p[2]) - bounds.min) * invExtent;
+        glm::vec3 normal = glm::normalize(glm::vec3(p[3], p[4], p[5]));
+
+        uint64_t position16 = glm::packUnorm4x16(glm::vec4(position, 0.f));
+        std::memcpy(packed[v].position, &position16, sizeof(packed[v].position));
+        packed[v].normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.f));
+    }
+    return packed;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "indexedmesh.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Layouts the static geometry can be stored in on the GPU.
+enum class VertexFormat {
+    VERTEX_FLOAT,  // 3 float position + 3 float normal, 24 bytes
+    VERTEX_COMPACT // 16-bit unorm position within the mesh bounds + 10:10:10:2 normal, 12 bytes
+};
+
+// Axis-aligned bounds of a mesh in object space.
+struct MeshBounds {
+    glm::vec3 min;
+    glm::vec3 extent; // max - min
+};
+
+// A vertex in the VERTEX_COMPACT layout.
+struct CompactVertex {
+    uint16_t position[4]; // xyz normalized to the mesh bounds, w unused
+    uint32_t normal;      // Signed normalized, GL_INT_2_10_10_10_REV
+};
+static_assert(sizeof(CompactVertex) == 12, "CompactVertex must be tightly packed");
+
+// Size in bytes of one vertex of the given format.
+int vertexStride(VertexFormat format);
+
+// Computes the bounds of an interleaved position/normal mesh.
+MeshBounds computeMeshBounds(const IndexedMesh &mesh);
+
+// Packs an interleaved position/normal mesh into the VERTEX_COMPACT layout.
+// Positions are quantized relative to bounds; the vertex shader decodes them
+// as bounds.min + position * bounds.extent.
+std::vector<CompactVertex> packCompactVertices(const IndexedMesh &mesh, const MeshBounds &bounds);
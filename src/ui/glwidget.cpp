@@ -1,7 +1,16 @@
 #include "glwidget.h"
+#include "parser/scenediff.h"
+#include "parser/scenepager.h"
+#include "render/frustum.h"
+#include "render/indexedmesh.h"
 #include <iostream>
 #include <QOpenGLFunctions>
+#include <QElapsedTimer>
+#include <QOpenGLVersionFunctionsFactory>
+#include <QPainter>
 #include <glm/gtc/matrix_transform.hpp>
+#include <numeric>
+#include <unordered_map>
 
 // Students: ignore this file
 
@@ -460,49 +469,304 @@ static QMatrix4x4 glmMatToQMat(glm::mat4x4 m) {
  * ==================================================
  */
 static const char *vertexShaderSourceCore =
-    "#version 330 core\n"
     "layout(location = 0) in vec3 position; // Position of the vertex\n"
     "layout(location = 1) in vec3 normal;   // Normal of the vertex\n"
+    "layout(location = 2) in mat3x4 mRows;  // Rows of the instance's affine model matrix (locations 2-4)\n"
+    "layout(location = 5) in uvec2 ids;     // Mesh and material of the instance\n"
     "out vec4 fragPos;\n"
     "out vec4 fragNormal;\n"
+    "flat out uint fragMaterial;\n"
+    "// Object-space position and normal, for texture coordinates\n"
+    "out vec3 fragObjectPos;\n"
+    "out vec3 fragObjectNormal;\n"
+    "flat out int fragUvMapping;\n"
     "uniform mat4 p;\n"
     "uniform mat4 v;\n"
-    "uniform mat4 m;\n"
+    "// Set while drawing a shape with a projective CTM, which is passed whole in model instead of mRows\n"
+    "uniform bool projectiveModel;\n"
+    "uniform mat4 model;\n"
+    "// Per mesh: offset (w = uv mapping) and scale mapping stored positions to object space\n"
+    "uniform samplerBuffer meshDecode;\n"
     "void main() {\n"
-    "    fragPos = m * vec4(position, 1.f);\n"
-    "    fragNormal = vec4(normalize(mat3(transpose(inverse(m))) * normal), 0);\n"
-    "    gl_Position = p * v * fragPos;\n"
+    "    vec4 decodeOffset = texelFetch(meshDecode, int(ids.x) * 2);\n"
+    "    vec3 decodeScale = texelFetch(meshDecode, int(ids.x) * 2 + 1).xyz;\n"
+    "    vec3 objectPos = decodeOffset.xyz + position * decodeScale;\n"
+    "    vec4 worldPos;\n"
+    "    if (projectiveModel) {\n"
+    "        worldPos = model * vec4(objectPos, 1.f);\n"
+    "        fragPos = vec4(worldPos.xyz / worldPos.w, 1.f);\n"
+    "        fragNormal = vec4(normalize(mat3(transpose(inverse(model))) * normal), 0);\n"
+    "    }\n"
+    "    else {\n"
+    "        mat4x3 m = transpose(mRows);\n"
+    "        worldPos = vec4(m * vec4(objectPos, 1.f), 1.f);\n"
+    "        fragPos = worldPos;\n"
+    "        fragNormal = vec4(normalize(transpose(inverse(mat3(m))) * normal), 0);\n"
+    "    }\n"
+    "    fragMaterial = ids.y;\n"
+    "    fragObjectPos = objectPos;\n"
+    "    fragObjectNormal = normal;\n"
+    "    fragUvMapping = int(decodeOffset.w);\n"
+    "    gl_Position = p * v * worldPos;\n"
     "}\n";
 
 static const char *fragmentShaderSourceCore =
-    "#version 330 core\n"
     "// fragment shader input in world space\n"
     "in vec4 fragPos;\n"
     "in vec4 fragNormal;\n"
+    "flat in uint fragMaterial;\n"
+    "in vec3 fragObjectPos;\n"
+    "in vec3 fragObjectNormal;\n"
+    "flat in int fragUvMapping;\n"
     "// fragment shader output\n"
     "out vec4 fragColor;\n"
-    "uniform vec3 lightPos;\n"
+    "uniform mat4 v;\n"
+    "uniform vec3 cameraPos;\n"
+    "// Per material: ambient, diffuse, specular (w = shininess),\n"
+    "// texture (blend, repeatU, repeatV, w = index into textureLayers plus one, or 0)\n"
+    "uniform samplerBuffer materials;\n"
+    "// Per scene texture: array (-1 while not loaded) and layer in textureArrays\n"
+    "uniform samplerBuffer textureLayers;\n"
+    "uniform sampler2DArray textureArrays[MAX_TEXTURE_ARRAYS];\n"
+    "// Per light: position (w = type: 0 point, 1 directional, 2 spot), direction (w = angle),\n"
+    "// color (w = range), attenuation (w = penumbra)\n"
+    "uniform samplerBuffer lights;\n"
+    "// Per cluster: offset and count of its entries in clusterLights\n"
+    "uniform usamplerBuffer clusters;\n"
+    "uniform usamplerBuffer clusterLights;\n"
+    "layout(std140) uniform Scene {\n"
+    "    vec4 globalCoeffs;  // ka, kd, ks, kt\n"
+    "    ivec4 lightCounts;  // x = global lights, which every fragment evaluates\n"
+    "    vec4 clusterParams; // xy = tiles per pixel, z = slice scale, w = slice bias\n"
+    "    ivec4 clusterDims;\n"
+    "};\n"
+    "const float PI = 3.14159265;\n"
+    "// Maps an object-space point on a unit primitive to [0, 1]^2, per uv mapping mode:\n"
+    "// 1 cube, 2 sphere, 3 cylinder or cone\n"
+    "vec2 textureCoords(vec3 p, vec3 n, int mapping) {\n"
+    "    if (mapping == 1 || (mapping == 3 && abs(n.y) > 0.99)) {\n"
+    "        // Planar per face, from the dominant axis of the normal\n"
+    "        vec3 a = abs(n);\n"
+    "        if (a.x >= a.y && a.x >= a.z) return vec2(n.x > 0.0 ? -p.z : p.z, p.y) + 0.5;\n"
+    "        if (a.y >= a.z) return vec2(p.x, n.y > 0.0 ? -p.z : p.z) + 0.5;\n"
+    "        return vec2(n.z > 0.0 ? p.x : -p.x, p.y) + 0.5;\n"
+    "    }\n"
+    "    float theta = atan(p.z, p.x);\n"
+    "    float u = theta < 0.0 ? -theta / (2.0 * PI) : 1.0 - theta / (2.0 * PI);\n"
+    "    if (mapping == 2) {\n"
+    "        return vec2(u, asin(clamp(p.y / max(length(p), 1e-6), -1.0, 1.0)) / PI + 0.5);\n"
+    "    }\n"
+    "    return vec2(u, p.y + 0.5);\n"
+    "}\n"
+    "vec3 sampleTextureArray(int array, vec3 coords, vec2 dx, vec2 dy) {\n"
+    "    // Sampler arrays can only be indexed with constants in GLSL 3.30\n"
+    "    if (array == 0) return textureGrad(textureArrays[0], coords, dx, dy).rgb;\n"
+    "    if (array == 1) return textureGrad(textureArrays[1], coords, dx, dy).rgb;\n"
+    "    if (array == 2) return textureGrad(textureArrays[2], coords, dx, dy).rgb;\n"
+    "    return textureGrad(textureArrays[3], coords, dx, dy).rgb;\n"
+    "}\n"
+    "vec3 shadeLight(int i, vec3 N, vec3 V, vec3 diffuse, vec4 specular) {\n"
+    "    vec4 position = texelFetch(lights, i * LIGHT_TEXELS);\n"
+    "    vec4 direction = texelFetch(lights, i * LIGHT_TEXELS + 1);\n"
+    "    vec4 color = texelFetch(lights, i * LIGHT_TEXELS + 2);\n"
+    "    vec4 attenuation = texelFetch(lights, i * LIGHT_TEXELS + 3);\n"
+    "    int type = int(position.w);\n"
+    "    vec3 L;\n"
+    "    float intensity = 1.0;\n"
+    "    if (type == 1) {\n"
+    "        L = normalize(-direction.xyz);\n"
+    "    }\n"
+    "    else {\n"
+    "        vec3 toLight = position.xyz - vec3(fragPos);\n"
+    "        float d = length(toLight);\n"
+    "        vec3 c = attenuation.xyz;\n"
+    "        L = toLight / d;\n"
+    "        intensity = min(1.0, 1.0 / (c.x + d * (c.y + d * c.z)));\n"
+    "        if (type == 2) {\n"
+    "            float inner = direction.w - attenuation.w;\n"
+    "            float x = acos(clamp(dot(normalize(direction.xyz), -L), -1.0, 1.0));\n"
+    "            float t = clamp((x - inner) / max(direction.w - inner, 1e-6), 0.0, 1.0);\n"
+    "            intensity *= x > direction.w ? 0.0 : 1.0 - t * t * (3.0 - 2.0 * t);\n"
+    "        }\n"
+    "    }\n"
+    "    float NL = max(dot(N, L), 0.0);\n"
+    "    float RV = max(dot(reflect(-L, N), V), 0.0);\n"
+    "    float spec = specular.w > 0.0 ? pow(RV, specular.w) : 1.0;\n"
+    "    return intensity * color.rgb * (globalCoeffs.y * diffuse * NL + globalCoeffs.z * specular.rgb * spec);\n"
+    "}\n"
     "void main() {\n"
-    "   vec3 L = normalize(lightPos - vec3(fragPos));\n"
-    "   float NL = max(dot(normalize(vec3(fragNormal)), L), 0.0);\n"
-    "   vec3 color = vec3(1.0, 0.78, 0.0);\n"
-    "   vec3 col = clamp(color * 0.2 + color * 0.8 * NL, 0.0, 1.0);\n"
-    "   fragColor = vec4(col, 1.0);\n"
+    "   int base = int(fragMaterial) * MATERIAL_TEXELS;\n"
+    "   vec3 ambient = texelFetch(materials, base).rgb;\n"
+    "   vec3 diffuse = texelFetch(materials, base + 1).rgb;\n"
+    "   vec4 specular = texelFetch(materials, base + 2);\n"
+    "   vec4 textureParams = texelFetch(materials, base + 3);\n"
+    "   // Gradients are taken outside the branches, which differ between neighbouring shapes\n"
+    "   vec2 uv = textureCoords(fragObjectPos, normalize(fragObjectNormal), fragUvMapping) * textureParams.yz;\n"
+    "   vec2 uvDx = dFdx(uv);\n"
+    "   vec2 uvDy = dFdy(uv);\n"
+    "   if (textureParams.w > 0.0 && fragUvMapping > 0) {\n"
+    "       vec2 placement = texelFetch(textureLayers, int(textureParams.w) - 1).xy;\n"
+    "       if (placement.x >= 0.0) {\n"
+    "           vec3 texel = sampleTextureArray(int(placement.x), vec3(uv, placement.y), uvDx, uvDy);\n"
+    "           diffuse = mix(diffuse, texel, textureParams.x);\n"
+    "       }\n"
+    "   }\n"
+    "   vec3 N = normalize(vec3(fragNormal));\n"
+    "   vec3 V = normalize(cameraPos - vec3(fragPos));\n"
+    "   vec3 col = globalCoeffs.x * ambient;\n"
+    "   for (int i = 0; i < lightCounts.x; i++) {\n"
+    "       col += shadeLight(i, N, V, diffuse, specular);\n"
+    "   }\n"
+    "   // Only the lights assigned to this fragment's cluster can reach it\n"
+    "   ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy), clusterDims.xy - 1);\n"
+    "   float depth = -(v * fragPos).z;\n"
+    "   int slice = clamp(int(floor(log(depth) * clusterParams.z + clusterParams.w)), 0, clusterDims.z - 1);\n"
+    "   uvec2 cluster = texelFetch(clusters, (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x).xy;\n"
+    "   for (uint k = 0u; k < cluster.y; k++) {\n"
+    "       col += shadeLight(int(texelFetch(clusterLights, int(cluster.x + k)).x), N, V, diffuse, specular);\n"
+    "   }\n"
+    "   fragColor = vec4(clamp(col, 0.0, 1.0), 1.0);\n"
     "}\n";
 
+// Prepends the GLSL version and the defines shared with the C++ side to a shader body
+static QByteArray shaderSource(const char *body) {
+    QByteArray source = "#version 330 core\n";
+    source += "#define LIGHT_TEXELS " + QByteArray::number(LightTexels) + "\n";
+    source += "#define MATERIAL_TEXELS " + QByteArray::number(MaterialTexels) + "\n";
+    source += "#define MAX_TEXTURE_ARRAYS " + QByteArray::number(TextureArrays::MaxArrays) + "\n";
+    return source + body;
+}
+
+// Attribute locations of the per-instance data
+static const GLuint InstanceModelLocation = 2; // Takes locations 2-4
+static const GLuint InstanceIdsLocation = 5;   // Mesh and material ids
+
+// Texture units of the lookup tables
+static const GLuint MeshDecodeUnit = 0;
+static const GLuint MaterialsUnit = 1;
+static const GLuint LightsUnit = 2;
+static const GLuint ClustersUnit = 3;
+static const GLuint ClusterLightsUnit = 4;
+static const GLuint TextureLayersUnit = 5;
+static const GLuint TextureArraysUnit = 6; // Takes TextureArrays::MaxArrays units
+static_assert(TextureArrays::MaxArrays == 4, "sampleTextureArray in the fragment shader expects four arrays");
+
+// Uniform buffer binding point of the Scene block
+static const GLuint SceneBinding = 0;
+
+// Clip planes of the preview camera
+static const float NearPlane = 0.01f;
+static const float FarPlane = 100.f;
+
+GLWidget::GLWidget(QWidget *parent) : QOpenGLWidget(parent) {
+    // Camera until a scene is loaded
+    m_view = glm::lookAt(glm::vec3(8.f, 8.f, 8.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+    m_cameraPos = glm::vec3(8.f, 8.f, 8.f);
+    m_fovy = glm::radians(60.f);
+
+    // Textures finish decoding on worker threads; upload them on the GUI thread once they arrive
+    QObject::connect(&m_textures, &TextureManager::textureDecoded, this, [this]() {
+        m_texturesDirty = true;
+        update();
+    }, Qt::QueuedConnection);
+}
+
 GLWidget::~GLWidget() {
-    m_vaoCone.destroy();
-    m_vboCone.destroy();
-    m_vaoCylinder.destroy();
-    m_vboCylinder.destroy();
-    m_vaoCube.destroy();
-    m_vboCube.destroy();
-    m_vaoSphere.destroy();
-    m_vboSphere.destroy();
+    makeCurrent();
+    m_vao.destroy();
+    m_vbo.destroy();
+    m_ebo.destroy();
+    m_instanceVbo.destroy();
+    m_meshDecode.destroy();
+    m_materials.destroy();
+    m_lights.destroy();
+    m_clusters.destroy();
+    m_clusterLights.destroy();
+    m_textureArrays.destroy();
+    m_textureLayers.destroy();
+    m_gpuTimer.destroy();
+    if (m_gl != nullptr) {
+        m_gl->glDeleteBuffers(1, &m_sceneUbo);
+        m_gl->glDeleteBuffers(1, &m_indirectBuffer);
+    }
+    doneCurrent();
+}
+
+void GLWidget::setVertexFormat(VertexFormat format) {
+    m_vertexFormat = format;
+}
+
+void GLWidget::setShapeOrder(ShapeOrder order) {
+    m_shapeOrder = order;
+}
+
+void GLWidget::setRenderPolicy(RenderPolicy policy) {
+    m_renderPolicy = policy;
+    update();
+}
+
+void GLWidget::renderFrameNow() {
+    // Forces initializeGL if the widget has never been painted
+    if (m_gl == nullptr) {
+        grabFramebuffer();
+    }
+    makeCurrent();
+    paintGL();
+    m_gl->glFinish();
+    doneCurrent();
+}
+
+void GLWidget::waitForTextures() {
+    // Forces initializeGL if the widget has never been painted
+    if (m_gl == nullptr) {
+        grabFramebuffer();
+    }
+    makeCurrent();
+    if (m_sceneDirty) {
+        uploadSceneTables();
+    }
+    // Resampling only starts once the texture is decoded and placed
+    do {
+        m_textures.waitForDone();
+    } while (updateTextures());
+    doneCurrent();
+}
+
+void GLWidget::setStatsOverlay(bool enabled) {
+    if (m_statsOverlay != enabled) {
+        m_statsOverlay = enabled;
+        update();
+    }
+}
+
+void GLWidget::setFrameCallback(std::function<void(const FrameStats &)> callback) {
+    m_frameCallback = std::move(callback);
+}
+
+void GLWidget::setCamera(const glm::vec3 &pos, const glm::vec3 &look, const glm::vec3 &up) {
+    glm::mat4 view = glm::lookAt(pos, pos + look, up);
+    if (view == m_view && pos == m_cameraPos) {
+        return;
+    }
+
+    m_cameraPos = pos;
+    m_view = view;
+    if (m_pager != nullptr) {
+        m_pager->update(pos);
+    }
+    m_instancesDirty = true;
+    m_clustersDirty = true;
+    // The headlight of a scene without lights sits at the camera
+    if (m_renderData.lights.empty()) {
+        m_lightsDirty = true;
+    }
+    update();
 }
 
 void GLWidget::initializeGL() {
     QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    m_gl = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_4_1_Core>(context());
+    m_gl->initializeOpenGLFunctions();
 
     f->glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -511,141 +775,567 @@ void GLWidget::initializeGL() {
     f->glCullFace(GL_BACK);
     f->glFrontFace(GL_CCW);
 
-    m_program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShaderSourceCore);
-    m_program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShaderSourceCore);
+    m_program.addShaderFromSourceCode(QOpenGLShader::Vertex, shaderSource(vertexShaderSourceCore));
+    m_program.addShaderFromSourceCode(QOpenGLShader::Fragment, shaderSource(fragmentShaderSourceCore));
     m_program.link();
     m_program.bind();
+    m_gl->glUniformBlockBinding(m_program.programId(), m_gl->glGetUniformBlockIndex(m_program.programId(), "Scene"), SceneBinding);
 
-    // Camera
-    m_view = glm::lookAt(glm::vec3(8.f, 8.f, 8.f), glm::vec3(0.f, 0.f, 0.f), glm::vec3(0.f, 1.f, 0.f));
-    m_fovy = glm::radians(60.f);
-    m_proj = glm::perspective(m_fovy, (float)width() / height(), 0.01f, 100.0f);
-
-    // Cone
-    m_vaoCone.create();
-    m_vaoCone.bind();
-    m_vboCone.create();
-    m_vboCone.bind();
-    m_vboCone.allocate(ConeData, ConeVertexNum * sizeof(GLfloat));
-    f->glEnableVertexAttribArray(0);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-    m_vboCone.release(QOpenGLBuffer::VertexBuffer);
-    m_vaoCone.release();
-
-    // Cube
-    m_vaoCube.create();
-    m_vaoCube.bind();
-    m_vboCube.create();
-    m_vboCube.bind();
-    m_vboCube.allocate(CubeData, CubeVertexNum * sizeof(GLfloat));
-    f->glEnableVertexAttribArray(0);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-    m_vboCube.release(QOpenGLBuffer::VertexBuffer);
-    m_vaoCube.release();
-
-    // Cylinder
-    m_vaoCylinder.create();
-    m_vaoCylinder.bind();
-    m_vboCylinder.create();
-    m_vboCylinder.bind();
-    m_vboCylinder.allocate(CylinderData, CylinderVertexNum * sizeof(GLfloat));
-    f->glEnableVertexAttribArray(0);
-    f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-    m_vboCylinder.release(QOpenGLBuffer::VertexBuffer);
-    m_vaoCylinder.release();
-
-    // Sphere
-    m_vaoSphere.create();
-    m_vaoSphere.bind();
-    m_vboSphere.create();
-    m_vboSphere.bind();
-    m_vboSphere.allocate(SphereData, SphereVertexNum * sizeof(GLfloat));
+    setProjection(width(), height());
+
+    // Primitives are deduplicated, vertex-cache-ordered and packed into one shared buffer
+    m_meshBuffer.clear(m_vertexFormat);
+    m_primitiveMeshes.fill(-1);
+    m_primitiveMeshes[(size_t)PrimitiveType::PRIMITIVE_CONE] = m_meshBuffer.addMesh(buildIndexedMesh(ConeData, ConeVertexNum), UvMapping::UV_CYLINDER);
+    m_primitiveMeshes[(size_t)PrimitiveType::PRIMITIVE_CUBE] = m_meshBuffer.addMesh(buildIndexedMesh(CubeData, CubeVertexNum), UvMapping::UV_CUBE);
+    m_primitiveMeshes[(size_t)PrimitiveType::PRIMITIVE_CYLINDER] = m_meshBuffer.addMesh(buildIndexedMesh(CylinderData, CylinderVertexNum), UvMapping::UV_CYLINDER);
+    m_primitiveMeshes[(size_t)PrimitiveType::PRIMITIVE_SPHERE] = m_meshBuffer.addMesh(buildIndexedMesh(SphereData, SphereVertexNum), UvMapping::UV_SPHERE);
+
+    m_vao.create();
+    m_vao.bind();
+
+    m_vbo.create();
+    m_vbo.bind();
+    m_vbo.allocate(m_meshBuffer.vertexData().data(), m_meshBuffer.vertexData().size());
     f->glEnableVertexAttribArray(0);
     f->glEnableVertexAttribArray(1);
-    f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
-    f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
-    m_vboSphere.release(QOpenGLBuffer::VertexBuffer);
-    m_vaoSphere.release();
+    if (m_vertexFormat == VertexFormat::VERTEX_COMPACT) {
+        // Positions are decoded to object space in the vertex shader, normals are unpacked by GL
+        f->glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex),
+                                 reinterpret_cast<void *>(offsetof(CompactVertex, position)));
+        f->glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex),
+                                 reinterpret_cast<void *>(offsetof(CompactVertex, normal)));
+    }
+    else {
+        f->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), nullptr);
+        f->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), reinterpret_cast<void *>(3 * sizeof(GLfloat)));
+    }
+
+    // The element buffer binding is part of the VAO state, so it stays bound
+    m_ebo.create();
+    m_ebo.bind();
+    m_ebo.allocate(m_meshBuffer.indices().data(), m_meshBuffer.indices().size() * sizeof(GLuint));
+
+    // Per-instance model matrices, one vec4 row per attribute location, and ids
+    m_instanceVbo.create();
+    m_instanceVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_instanceVbo.bind();
+    for (GLuint i = 0; i < 3; i++) {
+        f->glEnableVertexAttribArray(InstanceModelLocation + i);
+        m_gl->glVertexAttribDivisor(InstanceModelLocation + i, 1);
+    }
+    f->glEnableVertexAttribArray(InstanceIdsLocation);
+    m_gl->glVertexAttribDivisor(InstanceIdsLocation, 1);
+    setInstanceOffset(0);
+
+    m_vbo.release(QOpenGLBuffer::VertexBuffer);
+    m_vao.release();
+
+    std::vector<glm::vec4> decodeTable = m_meshBuffer.decodeTable();
+    m_meshDecode.create(m_gl, GL_RGBA32F);
+    m_meshDecode.upload(decodeTable.data(), decodeTable.size() * sizeof(glm::vec4));
+
+    // Scene tables, filled in whenever a scene is loaded
+    m_materials.create(m_gl, GL_RGBA32F);
+    m_lights.create(m_gl, GL_RGBA32F);
+    m_clusters.create(m_gl, GL_RG32UI);
+    m_clusterLights.create(m_gl, GL_R32UI);
+    m_textureArrays.create(m_gl);
+    m_textureLayers.create(m_gl, GL_RG32F);
+    m_gl->glGenBuffers(1, &m_sceneUbo);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, m_sceneUbo);
+    m_gl->glBufferData(GL_UNIFORM_BUFFER, sizeof(GpuSceneBlock), nullptr, GL_DYNAMIC_DRAW);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    // Multi-draw indirect needs GL 4.3; older contexts fall back to one instanced draw per mesh
+    if (context()->format().version() >= qMakePair(4, 3)) {
+        m_gl43 = QOpenGLVersionFunctionsFactory::get<QOpenGLFunctions_4_3_Core>(context());
+    }
+    if (m_gl43 != nullptr) {
+        m_gl43->initializeOpenGLFunctions();
+        m_gl43->glGenBuffers(1, &m_indirectBuffer);
+    }
+
+    // GPU times are reported as unknown where timer queries are missing
+    m_gpuTimer.create();
+
+    m_sceneDirty = true;
+}
+
+void GLWidget::setInstanceOffset(GLuint firstInstance) {
+    // Expects the VAO and the instance buffer to be bound
+    size_t base = firstInstance * sizeof(ShapeInstance);
+    for (GLuint i = 0; i < 3; i++) {
+        m_gl->glVertexAttribPointer(InstanceModelLocation + i, 4, GL_FLOAT, GL_FALSE, sizeof(ShapeInstance),
+                                    reinterpret_cast<void *>(base + offsetof(ShapeInstance, modelRows) + i * sizeof(glm::vec4)));
+    }
+    static_assert(offsetof(ShapeInstance, materialId) == offsetof(ShapeInstance, meshId) + sizeof(uint32_t));
+    m_gl->glVertexAttribIPointer(InstanceIdsLocation, 2, GL_UNSIGNED_INT, sizeof(ShapeInstance),
+                                 reinterpret_cast<void *>(base + offsetof(ShapeInstance, meshId)));
+}
+
+void GLWidget::uploadSceneTables() {
+    // Materials and lights are uploaded once per scene; instances only index into them
+    m_materialTable.clear();
+    m_texturePaths.clear();
+    m_textureSlots.clear();
+    m_texturePlacements.clear();
+    m_textureArrays.clear();
+    m_shapes.resize(m_renderData.shapes.size());
+    for (size_t i = 0; i < m_renderData.shapes.size(); i++) {
+        updateShape(i);
+    }
+    const std::vector<GpuMaterial> &materials = m_materialTable.materials();
+    m_materials.upload(materials.data(), materials.size() * sizeof(GpuMaterial));
+    uploadLights();
+
+    m_texturesDirty = true;
+    m_instancesDirty = true;
+    m_materialsDirty = false;
+    m_sceneDirty = false;
+}
+
+void GLWidget::updateShape(size_t i) {
+    const RenderShapeData &shape = m_renderData.shapes[i];
+    int meshId = m_primitiveMeshes[(size_t)shape.primitive.type];
+    MeshBounds bounds = meshId >= 0 ? m_meshBuffer.bounds(meshId) : MeshBounds{};
+    m_shapes.set(i, shape, meshId, bounds, shapeMaterial(shape));
+}
+
+uint32_t GLWidget::shapeMaterial(const RenderShapeData &shape) {
+    const SceneMaterial &material = shape.primitive.material;
+    uint32_t texture = 0;
+    if (material.textureMap.isUsed) {
+        auto [it, inserted] = m_textureSlots.emplace(material.textureMap.filename, (uint32_t)m_texturePaths.size() + 1);
+        if (inserted) {
+            m_texturePaths.push_back(material.textureMap.filename);
+            m_textures.request(material.textureMap.filename);
+            m_texturesDirty = true;
+        }
+        texture = it->second;
+    }
+    return m_materialTable.indexOf(material, texture);
+}
+
+void GLWidget::uploadLights() {
+    m_globalLightCount = packLights(m_renderData, m_cameraPos, m_lightList);
+    m_lights.upload(m_lightList.data(), m_lightList.size() * sizeof(GpuLight));
+    m_clustersDirty = true;
+    m_lightsDirty = false;
+}
+
+void GLWidget::uploadInstances() {
+    // Shapes whose bounds are outside the view are left out of the instance
+    // buffer, and the rest sorted by mesh, then near to far within each batch
+    Frustum frustum = Frustum::fromMatrix(m_proj * m_view);
+    m_renderQueue.build(m_shapes, frustum, m_view, FarPlane, m_meshBuffer.meshCount());
+    m_renderQueue.sort();
+    buildInstanceBatches(m_shapes, m_renderQueue, m_instances, m_batches);
+    for (uint32_t shape : m_renderQueue.projectiveShapes()) {
+        // Unbounded, so never culled, and drawn apart with their full
+        // matrices; only the ids are read from the instance
+        m_instances.push_back(ShapeInstance{glm::mat3x4(1.f), (uint32_t)m_shapes.meshId(shape), m_shapes.material(shape)});
+    }
+
+    m_instanceVbo.bind();
+    m_instanceVbo.allocate(m_instances.data(), m_instances.size() * sizeof(ShapeInstance));
+    m_instanceVbo.release();
+
+    if (m_gl43 != nullptr) {
+        buildIndirectCommands(m_batches, m_meshBuffer, m_indirectCommands);
+        m_gl43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        m_gl43->glBufferData(GL_DRAW_INDIRECT_BUFFER, m_indirectCommands.size() * sizeof(DrawElementsIndirectCommand),
+                             m_indirectCommands.data(), GL_DYNAMIC_DRAW);
+        m_gl43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    m_instancesDirty = false;
+}
+
+void GLWidget::drawProjectiveShapes() {
+    // Expects the program and the VAO to be bound
+    m_program.setUniformValue(m_program.uniformLocation("projectiveModel"), (GLint)1);
+    m_instanceVbo.bind();
+    const std::vector<uint32_t> &projectiveShapes = m_renderQueue.projectiveShapes();
+    size_t firstInstance = m_instances.size() - projectiveShapes.size();
+    for (size_t k = 0; k < projectiveShapes.size(); k++) {
+        uint32_t shape = projectiveShapes[k];
+        const MeshRange &range = m_meshBuffer.range(m_shapes.meshId(shape));
+        m_program.setUniformValue(m_program.uniformLocation("model"), glmMatToQMat(m_renderData.shapes[shape].ctm));
+        setInstanceOffset((GLuint)(firstInstance + k));
+        m_gl->glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                      reinterpret_cast<void *>(range.firstIndex * sizeof(GLuint)), 1);
+    }
+    // Multi-draw reads the batches' instances from the start of the buffer
+    setInstanceOffset(0);
+    m_instanceVbo.release();
+    m_program.setUniformValue(m_program.uniformLocation("projectiveModel"), (GLint)0);
+}
+
+void GLWidget::updateClusters() {
+    m_clusterGrid.assign(m_lightList, m_globalLightCount, m_view);
+    const std::vector<glm::uvec2> &clusters = m_clusterGrid.clusters();
+    const std::vector<uint32_t> &clusterLights = m_clusterGrid.lightIndices();
+    m_clusters.upload(clusters.data(), clusters.size() * sizeof(glm::uvec2));
+    m_clusterLights.upload(clusterLights.data(), clusterLights.size() * sizeof(uint32_t));
+
+    float framebufferWidth = width() * devicePixelRatioF();
+    float framebufferHeight = height() * devicePixelRatioF();
+
+    GpuSceneBlock scene;
+    const SceneGlobalData &global = m_renderData.globalData;
+    scene.globalCoeffs = glm::vec4(global.ka, global.kd, global.ks, global.kt);
+    scene.lightCounts = glm::ivec4(m_globalLightCount, m_lightList.size(), 0, 0);
+    scene.clusterParams = glm::vec4(m_clusterGrid.tilesX() / framebufferWidth, m_clusterGrid.tilesY() / framebufferHeight,
+                                    m_clusterGrid.sliceScale(), m_clusterGrid.sliceBias());
+    scene.clusterDims = glm::ivec4(m_clusterGrid.tilesX(), m_clusterGrid.tilesY(), m_clusterGrid.slices(), 0);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, m_sceneUbo);
+    m_gl->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(GpuSceneBlock), &scene);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    m_clustersDirty = false;
+}
+
+void GLWidget::setProjection(int w, int h) {
+    float aspect = (float)w / h;
+    m_proj = glm::perspective(m_fovy, aspect, NearPlane, FarPlane);
+    m_clusterGrid.setProjection(m_fovy, aspect, NearPlane, FarPlane);
+    m_clustersDirty = true;
+    m_instancesDirty = true;
+}
+
+bool GLWidget::updateTextures() {
+    // Only textures which arrived since the last update are uploaded. Those
+    // that must be resampled to fit an array are resampled on the decode pool
+    // and placed once that is done. Returns whether any still are.
+    m_texturePlacements.resize(m_texturePaths.size());
+    bool pending = false;
+    for (size_t i = 0; i < m_texturePaths.size(); i++) {
+        TextureLayer &placement = m_texturePlacements[i];
+        if (placement.array >= 0 || placement.layer < 0) {
+            continue;
+        }
+        std::shared_ptr<const MipChain> mips = m_textures.mipChain(m_texturePaths[i]);
+        if (!mips) {
+            continue;
+        }
+
+        glm::ivec2 size(mips->front().width(), mips->front().height());
+        glm::ivec2 arraySize = m_textureArrays.arraySize(size);
+        if (arraySize != size) {
+            mips = m_textures.resampledMipChain(m_texturePaths[i], QSize(arraySize.x, arraySize.y));
+            if (!mips) {
+                pending = true;
+                continue;
+            }
+        }
+        placement = m_textureArrays.add(mips);
+        // A layer of -1 marks textures which did not fit, so they are not retried
+        if (placement.array < 0) {
+            placement.layer = -1;
+        }
+    }
+
+    std::vector<glm::vec2> layerTable(m_texturePlacements.size());
+    for (size_t i = 0; i < m_texturePlacements.size(); i++) {
+        layerTable[i] = glm::vec2(m_texturePlacements[i].array, m_texturePlacements[i].layer);
+    }
+    m_textureLayers.upload(layerTable.data(), layerTable.size() * sizeof(glm::vec2));
+
+    m_texturesDirty = false;
+    return pending;
 }
 
 void GLWidget::paintGL() {
     QOpenGLFunctions *f = QOpenGLContext::currentContext()->functions();
+    QElapsedTimer cpuTimer;
+    cpuTimer.start();
+    m_gpuTimer.begin();
 
+    if (m_pagesDirty) {
+        updatePagedScene();
+    }
+    if (m_sceneDirty) {
+        uploadSceneTables();
+    }
+    if (m_materialsDirty) {
+        const std::vector<GpuMaterial> &materials = m_materialTable.materials();
+        m_materials.upload(materials.data(), materials.size() * sizeof(GpuMaterial));
+        m_materialsDirty = false;
+    }
+    if (m_lightsDirty) {
+        uploadLights();
+    }
+    // The visible set depends on the view, so instances are rebuilt whenever the camera moves
+    if (m_instancesDirty) {
+        uploadInstances();
+    }
+    // Light assignment depends on the view, so it is redone whenever the camera moves
+    if (m_clustersDirty) {
+        updateClusters();
+    }
+    if (m_texturesDirty) {
+        updateTextures();
+    }
+
+    // The stats overlay paints with QPainter, which leaves GL state changed
+    f->glEnable(GL_DEPTH_TEST);
+    f->glEnable(GL_CULL_FACE);
+    f->glDisable(GL_BLEND);
+    f->glDisable(GL_SCISSOR_TEST);
     f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     m_program.bind();
 
-    m_program.setUniformValue(m_program.uniformLocation("lightPos"), m_lightPos);
+    m_program.setUniformValue(m_program.uniformLocation("cameraPos"), QVector3D(m_cameraPos.x, m_cameraPos.y, m_cameraPos.z));
     m_program.setUniformValue(m_program.uniformLocation("p"), glmMatToQMat(m_proj));
     m_program.setUniformValue(m_program.uniformLocation("v"), glmMatToQMat(m_view));
+    m_program.setUniformValue(m_program.uniformLocation("projectiveModel"), (GLint)0);
+    m_program.setUniformValue(m_program.uniformLocation("meshDecode"), (GLint)MeshDecodeUnit);
+    m_program.setUniformValue(m_program.uniformLocation("materials"), (GLint)MaterialsUnit);
+    m_program.setUniformValue(m_program.uniformLocation("lights"), (GLint)LightsUnit);
+    m_program.setUniformValue(m_program.uniformLocation("clusters"), (GLint)ClustersUnit);
+    m_program.setUniformValue(m_program.uniformLocation("clusterLights"), (GLint)ClusterLightsUnit);
+    m_program.setUniformValue(m_program.uniformLocation("textureLayers"), (GLint)TextureLayersUnit);
+    GLint arrayUnits[TextureArrays::MaxArrays];
+    for (int i = 0; i < TextureArrays::MaxArrays; i++) {
+        arrayUnits[i] = TextureArraysUnit + i;
+    }
+    m_program.setUniformValueArray(m_program.uniformLocation("textureArrays"), arrayUnits, TextureArrays::MaxArrays);
+    m_meshDecode.bind(MeshDecodeUnit);
+    m_materials.bind(MaterialsUnit);
+    m_lights.bind(LightsUnit);
+    m_clusters.bind(ClustersUnit);
+    m_clusterLights.bind(ClusterLightsUnit);
+    m_textureLayers.bind(TextureLayersUnit);
+    m_textureArrays.bind(TextureArraysUnit);
+    m_gl->glBindBufferBase(GL_UNIFORM_BUFFER, SceneBinding, m_sceneUbo);
 
-    for (auto & shape : m_renderData.shapes) {
-        auto &material = shape.primitive.material;
-        m_program.setUniformValue(m_program.uniformLocation("m"), glmMatToQMat(shape.ctm));
-
-        switch (shape.primitive.type) {
-        case PrimitiveType::PRIMITIVE_CONE:
-        {
-            m_vaoCone.bind();
-            f->glDrawArrays(GL_TRIANGLES, 0, ConeVertexNum / 6);
-            m_vaoCone.release();
-            break;
-        }
-        case PrimitiveType::PRIMITIVE_CYLINDER:
-        {
-            m_vaoCylinder.bind();
-            f->glDrawArrays(GL_TRIANGLES, 0, CylinderVertexNum / 6);
-            m_vaoCylinder.release();
-            break;
-        }
-        case PrimitiveType::PRIMITIVE_CUBE:
-        {
-            m_vaoCube.bind();
-            f->glDrawArrays(GL_TRIANGLES, 0, CubeVertexNum / 6);
-            m_vaoCube.release();
-            break;
-        }
-        case PrimitiveType::PRIMITIVE_SPHERE:
-        {
-            m_vaoSphere.bind();
-            f->glDrawArrays(GL_TRIANGLES, 0, SphereVertexNum / 6);
-            m_vaoSphere.release();
-            break;
-        }
-        default:
-            break;
+    m_vao.bind();
+
+    if (m_gl43 != nullptr) {
+        // All meshes in one submission; baseInstance selects each batch's instances
+        m_gl43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+        m_gl43->glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, (GLsizei)m_indirectCommands.size(), 0);
+        m_gl43->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else {
+        // Without base instance support, each batch re-points the instance attributes
+        m_instanceVbo.bind();
+        for (const DrawBatch &batch : m_batches) {
+            const MeshRange &range = m_meshBuffer.range(batch.meshId);
+            setInstanceOffset(batch.firstInstance);
+            m_gl->glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                                          reinterpret_cast<void *>(range.firstIndex * sizeof(GLuint)), batch.instanceCount);
         }
+        m_instanceVbo.release();
+    }
+    if (!m_renderQueue.projectiveShapes().empty()) {
+        drawProjectiveShapes();
     }
 
+    m_vao.release();
     m_program.release();
+    m_gpuTimer.end();
+
+    m_frameStats.cpuMs = cpuTimer.nsecsElapsed() / 1e6;
+    m_frameStats.gpuMs = m_gpuTimer.latestMs();
+    m_frameStats.drawCalls = m_gl43 != nullptr ? (m_batches.empty() ? 0 : 1) : (uint32_t)m_batches.size();
+    m_frameStats.drawCalls += (uint32_t)m_renderQueue.projectiveShapes().size();
+    m_frameStats.batches = (uint32_t)m_batches.size();
+    m_frameStats.instances = (uint32_t)m_instances.size();
+    m_frameStats.triangles = 0;
+    for (const DrawBatch &batch : m_batches) {
+        m_frameStats.triangles += (uint64_t)m_meshBuffer.range(batch.meshId).indexCount / 3 * batch.instanceCount;
+    }
+    for (uint32_t shape : m_renderQueue.projectiveShapes()) {
+        m_frameStats.triangles += m_meshBuffer.range(m_shapes.meshId(shape)).indexCount / 3;
+    }
+    m_frameStats.culled = (uint32_t)m_renderQueue.culled();
+
+    if (m_statsOverlay) {
+        drawStatsOverlay();
+    }
+    if (m_frameCallback) {
+        m_frameCallback(m_frameStats);
+    }
+    if (m_renderPolicy == RenderPolicy::RENDER_CONTINUOUS) {
+        update();
+    }
+}
+
+void GLWidget::drawStatsOverlay() {
+    QString gpu = m_frameStats.gpuMs < 0.0 ? QString("n/a") : QString::number(m_frameStats.gpuMs, 'f', 2) + " ms";
+    QString text = QString("cpu %1 ms\ngpu %2\ndraws %3 (%4 batches)\ninstances %5\ntriangles %6\nculled %7")
+                       .arg(m_frameStats.cpuMs, 0, 'f', 2)
+                       .arg(gpu)
+                       .arg(m_frameStats.drawCalls)
+                       .arg(m_frameStats.batches)
+                       .arg(m_frameStats.instances)
+                       .arg(m_frameStats.triangles)
+                       .arg(m_frameStats.culled);
+
+    QPainter painter(this);
+    painter.setPen(Qt::white);
+    painter.drawText(rect().adjusted(8, 8, -8, -8), Qt::AlignTop | Qt::AlignLeft, text);
 }
 
 void GLWidget::resizeGL(int w, int h) {
-    m_proj = glm::perspective(m_fovy, (float)w / h, 0.01f, 100.0f);
+    setProjection(w, h);
 }
 
 void GLWidget::loadScene(const RenderData &renderData) {
     std::cout << "GLWidget [loadScene] begin" << std::endl;
 
-    const auto &cameraData = renderData.cameraData;
-    glm::vec3 eye = glm::vec3(cameraData.pos);
-    glm::vec3 center = glm::vec3(cameraData.pos + cameraData.look);
-    glm::vec3 up = glm::vec3(cameraData.up);
-
-    m_lightPos = QVector3D(eye.x, eye.y, eye.z);
+    setPager(nullptr);
+    m_renderData = renderData;
+    orderShapes(m_renderData.shapes, m_shapeOrder, m_shapeOrigins);
+    m_sceneDirty = true;
 
+    const auto &cameraData = renderData.cameraData;
     m_fovy = cameraData.heightAngle;
-    m_view = glm::lookAt(eye, center, up);
-    m_proj = glm::perspective(m_fovy, (float)width() / height(), 0.01f, 100.0f);
+    setProjection(width(), height());
+    setCamera(glm::vec3(cameraData.pos), glm::vec3(cameraData.look), glm::vec3(cameraData.up));
 
-    m_renderData = renderData;
+    // Start decoding textures now so they are likely ready by the first frame
+    for (const RenderShapeData &shape : m_renderData.shapes) {
+        if (shape.primitive.material.textureMap.isUsed) {
+            m_textures.request(shape.primitive.material.textureMap.filename);
+        }
+    }
 
     update();
 
     std::cout << "GLWidget [loadScene] success" << std::endl;
 }
+
+void GLWidget::setPager(ScenePager *pager) {
+    QObject::disconnect(m_pagerConnection);
+    if (m_pager != nullptr) {
+        m_renderData = m_baseData;
+        m_sceneDirty = true;
+    }
+
+    m_pager = pager;
+    if (m_pager == nullptr) {
+        return;
+    }
+
+    // Groups finish loading on the pager's thread; rebuild the scene on the GUI thread
+    m_baseData = m_renderData;
+    m_pagerConnection = QObject::connect(m_pager, &ScenePager::pagesChanged, this, [this]() {
+        m_pagesDirty = true;
+        update();
+    }, Qt::QueuedConnection);
+    m_pager->update(m_cameraPos);
+    m_pagesDirty = true;
+    update();
+}
+
+void GLWidget::updatePagedScene() {
+    m_renderData.shapes = m_baseData.shapes;
+    m_renderData.lights = m_baseData.lights;
+    m_pager->collect(m_renderData);
+    orderShapes(m_renderData.shapes, m_shapeOrder, m_shapeOrigins);
+
+    for (const RenderShapeData &shape : m_renderData.shapes) {
+        if (shape.primitive.material.textureMap.isUsed) {
+            m_textures.request(shape.primitive.material.textureMap.filename);
+        }
+    }
+    m_pagesDirty = false;
+    m_sceneDirty = true;
+}
+
+void GLWidget::reloadScene(const RenderData &renderData) {
+    if (m_shapeOrder == ShapeOrder::SHAPE_ORDER_SCENE) {
+        applySceneEdit(renderData);
+        m_shapeOrigins.resize(renderData.shapes.size());
+        std::iota(m_shapeOrigins.begin(), m_shapeOrigins.end(), 0);
+        return;
+    }
+
+    // Diff against the edited scene in the same order, so shapes which did
+    // not move compare equal
+    RenderData ordered = renderData;
+    std::vector<uint32_t> origins;
+    orderShapes(ordered.shapes, m_shapeOrder, origins);
+    applySceneEdit(ordered);
+    m_shapeOrigins = std::move(origins);
+}
+
+void GLWidget::reloadTextures(const std::vector<std::string> &paths) {
+    for (const std::string &path : paths) {
+        auto slot = m_textureSlots.find(path);
+        if (slot == m_textureSlots.end()) {
+            continue;
+        }
+        // Placed again once decoded; the old layer stays unused until the next full upload
+        m_textures.reload(path);
+        if (slot->second <= m_texturePlacements.size()) {
+            m_texturePlacements[slot->second - 1] = TextureLayer{};
+        }
+    }
+    m_texturesDirty = true;
+    update();
+}
+
+void GLWidget::applySceneEdit(const RenderData &renderData) {
+    SceneDiff diff = diffScenes(m_renderData, renderData);
+    if (diff.empty()) {
+        return;
+    }
+
+    // Nothing has been uploaded from the current scene yet, so there is nothing to patch
+    if (m_sceneDirty) {
+        m_renderData = renderData;
+        diff.shapeCountChanged = false;
+        diff.changedShapes.clear();
+    }
+
+    if (diff.shapeCountChanged) {
+        std::vector<RenderShapeData> &shapes = m_renderData.shapes;
+        shapes.erase(shapes.begin() + diff.firstShape, shapes.begin() + diff.oldShapesEnd);
+        shapes.insert(shapes.begin() + diff.firstShape, renderData.shapes.begin() + diff.firstShape,
+                      renderData.shapes.begin() + diff.newShapesEnd);
+        m_shapes.replace(diff.firstShape, diff.oldShapesEnd, diff.newShapesEnd - diff.firstShape);
+        for (size_t i = diff.firstShape; i < diff.newShapesEnd; i++) {
+            diff.changedShapes.push_back(i);
+        }
+    }
+    else {
+        for (size_t i : diff.changedShapes) {
+            m_renderData.shapes[i] = renderData.shapes[i];
+        }
+    }
+
+    // Materials seen for the first time are appended to the table; ones no
+    // longer used stay in it until the next full upload
+    size_t materialCount = m_materialTable.materials().size();
+    for (size_t i : diff.changedShapes) {
+        updateShape(i);
+    }
+    if (m_materialTable.materials().size() != materialCount) {
+        m_materialsDirty = true;
+    }
+    if (!diff.changedShapes.empty()) {
+        m_instancesDirty = true;
+    }
+
+    if (diff.lightsChanged) {
+        m_renderData.lights = renderData.lights;
+        m_lightsDirty = true;
+    }
+    if (diff.globalChanged) {
+        m_renderData.globalData = renderData.globalData;
+        m_clustersDirty = true;
+    }
+    if (diff.cameraChanged) {
+        const SceneCameraData &cameraData = renderData.cameraData;
+        m_renderData.cameraData = cameraData;
+        m_fovy = cameraData.heightAngle;
+        setProjection(width(), height());
+        setCamera(glm::vec3(cameraData.pos), glm::vec3(cameraData.look), glm::vec3(cameraData.up));
+    }
+
+    update();
+}
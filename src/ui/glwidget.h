@@ -2,44 +2,179 @@
 #define GLWIDGET_H
 
 #include "parser/sceneparser.h"
+#include "parser/shapeorder.h"
+#include "render/framestats.h"
+#include "render/gpuscene.h"
+#include "render/instancing.h"
+#include "render/lightclusters.h"
+#include "render/meshbuffer.h"
+#include "render/renderqueue.h"
+#include "render/shapetable.h"
+#include "render/texturebuffer.h"
+#include "render/texturearrays.h"
+#include "render/texturemanager.h"
 #include <QOpenGLBuffer>
 #include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_1_Core>
+#include <QOpenGLFunctions_4_3_Core>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLWidget>
+#include <functional>
+#include <unordered_map>
+
+class ScenePager;
+
+// When the preview repaints: only after the camera, scene or size changed, or every frame.
+enum class RenderPolicy {
+    RENDER_ON_DEMAND,
+    RENDER_CONTINUOUS
+};
 
 class GLWidget : public QOpenGLWidget
 {
 public:
-    GLWidget(QWidget *parent) : QOpenGLWidget(parent) { }
+    GLWidget(QWidget *parent);
     ~GLWidget();
 
     void loadScene(const RenderData &renderData);
 
+    // Replaces the loaded scene by an edited version of it, uploading only the
+    // shapes, lights and camera which differ.
+    void reloadScene(const RenderData &renderData);
+    const RenderData &renderData() const { return m_renderData; }
+
+    // Decodes the given texture files of the loaded scene again, and draws
+    // them once they are.
+    void reloadTextures(const std::vector<std::string> &paths);
+
+    // Streams the groups of the loaded scene in and out through pager as the
+    // camera moves, on top of the shapes and lights loadScene was given.
+    // loadScene detaches the pager again.
+    void setPager(ScenePager *pager);
+
+    // Selects the vertex layout of the static geometry. Only takes effect if
+    // called before the widget's GL context is initialized.
+    void setVertexFormat(VertexFormat format);
+
+    // The order the loaded shapes are kept and drawn in. Takes effect from the
+    // next loadScene.
+    void setShapeOrder(ShapeOrder order);
+    // For each shape of renderData(), its index in the scene it was loaded from
+    const std::vector<uint32_t> &shapeOrigins() const { return m_shapeOrigins; }
+
+    void setRenderPolicy(RenderPolicy policy);
+
+    // Renders a frame into the widget's framebuffer immediately, without going
+    // through the event loop, and waits for the GPU to finish it. For benchmarks.
+    void renderFrameNow();
+
+    // Blocks until the scene's textures are decoded, so the next frame draws them.
+    void waitForTextures();
+
+    // Moves the camera, repainting only if the view actually changed.
+    void setCamera(const glm::vec3 &pos, const glm::vec3 &look, const glm::vec3 &up);
+
+    // Statistics of the last painted frame, optionally drawn over the preview.
+    const FrameStats &frameStats() const { return m_frameStats; }
+    void setStatsOverlay(bool enabled);
+    // Called after every frame with its statistics.
+    void setFrameCallback(std::function<void(const FrameStats &)> callback);
+
 protected:
     void initializeGL() override;
     void paintGL() override;
     void resizeGL(int w, int h) override;
 
 private:
+    void setInstanceOffset(GLuint firstInstance);
+    void uploadSceneTables();
+    void updateShape(size_t i);
+    uint32_t shapeMaterial(const RenderShapeData &shape);
+    void uploadLights();
+    void uploadInstances();
+    void drawProjectiveShapes();
+    void updateClusters();
+    void setProjection(int w, int h);
+    bool updateTextures();
+    void drawStatsOverlay();
+    void updatePagedScene();
+    void applySceneEdit(const RenderData &renderData);
+
+    QOpenGLFunctions_4_1_Core *m_gl = nullptr;
+    QOpenGLFunctions_4_3_Core *m_gl43 = nullptr; // Only set when multi-draw indirect is available
+
     QOpenGLShaderProgram m_program;
 
-    QOpenGLVertexArrayObject m_vaoCone;
-    QOpenGLVertexArrayObject m_vaoCube;
-    QOpenGLVertexArrayObject m_vaoCylinder;
-    QOpenGLVertexArrayObject m_vaoSphere;
+    // All static geometry lives in one vertex/index buffer pair behind one VAO
+    VertexFormat m_vertexFormat = VertexFormat::VERTEX_FLOAT;
+    StaticMeshBuffer m_meshBuffer;
+    PrimitiveMeshTable m_primitiveMeshes;
+    TextureBuffer m_meshDecode;
+
+    // Per-scene tables indexed by the instances
+    MaterialTable m_materialTable;
+    TextureBuffer m_materials;
+    TextureBuffer m_lights;
+    GLuint m_sceneUbo = 0;
+    bool m_materialsDirty = false;
+
+    // Lights, with the global ones first, and their clustered assignment for the current view
+    std::vector<GpuLight> m_lightList;
+    uint32_t m_globalLightCount = 0;
+    LightClusterGrid m_clusterGrid;
+    TextureBuffer m_clusters;
+    TextureBuffer m_clusterLights;
+    bool m_lightsDirty = false;
+    bool m_clustersDirty = true;
 
-    QOpenGLBuffer m_vboCone;
-    QOpenGLBuffer m_vboCube;
-    QOpenGLBuffer m_vboCylinder;
-    QOpenGLBuffer m_vboSphere;
+    QOpenGLVertexArrayObject m_vao;
+    QOpenGLBuffer m_vbo{QOpenGLBuffer::VertexBuffer};
+    QOpenGLBuffer m_ebo{QOpenGLBuffer::IndexBuffer};
+    QOpenGLBuffer m_instanceVbo{QOpenGLBuffer::VertexBuffer};
+    GLuint m_indirectBuffer = 0;
 
-    glm::mat4x4 m_view;
-    glm::mat4x4 m_proj;
+    // Image files of the scene's textured materials, decoded in the background
+    // and added to arrays as they arrive; m_textureLayers maps each path to its array layer
+    TextureManager m_textures;
+    std::vector<std::string> m_texturePaths;
+    std::unordered_map<std::string, uint32_t> m_textureSlots;
+    std::vector<TextureLayer> m_texturePlacements;
+    TextureArrays m_textureArrays;
+    TextureBuffer m_textureLayers;
+    bool m_texturesDirty = true;
+
+    // What culling and batching read of every shape
+    ShapeTable m_shapes;
+    bool m_sceneDirty = true;
+
+    RenderQueue m_renderQueue;
+    // The batches' instances, followed by one per projective shape in the queue
+    std::vector<ShapeInstance> m_instances;
+    std::vector<DrawBatch> m_batches;
+    std::vector<DrawElementsIndirectCommand> m_indirectCommands;
+    bool m_instancesDirty = true;
+
+    RenderPolicy m_renderPolicy = RenderPolicy::RENDER_ON_DEMAND;
+    FrameStats m_frameStats;
+    GpuFrameTimer m_gpuTimer;
+    bool m_statsOverlay = false;
+    std::function<void(const FrameStats &)> m_frameCallback;
+
+    glm::mat4x4 m_view{1.f};
+    glm::mat4x4 m_proj{1.f};
     float m_fovy;
-    QVector3D m_lightPos;
+    glm::vec3 m_cameraPos = glm::vec3(0.f);
+
+    RenderData m_renderData{};
+    ShapeOrder m_shapeOrder = ShapeOrder::SHAPE_ORDER_SCENE;
+    std::vector<uint32_t> m_shapeOrigins;
 
-    RenderData m_renderData;
+    // The scene as loaded, before the pager's groups are added
+    ScenePager *m_pager = nullptr;
+    QMetaObject::Connection m_pagerConnection;
+    RenderData m_baseData{};
+    bool m_pagesDirty = false;
 };
 
 #endif // GLWIDGET_H
@@ -1,17 +1,30 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
+#include "parser/scenedecompressor.h"
+#include "parser/scenepager.h"
 #include "parser/sceneparser.h"
+#include "parser/scenewatcher.h"
 
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
 
+// Uncompressed JSON scenes at least this large are paged rather than loaded whole
+static const qint64 PagedSceneSize = qint64(1) << 30;
+static const size_t PagingBudget = size_t(2) << 30;
+
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_watcher(std::make_unique<SceneWatcher>())
 {
     ui->setupUi(this);
+    connect(ui->actionWatch, SIGNAL(toggled(bool)), this, SLOT(watchScene(bool)));
+    connect(m_watcher.get(), SIGNAL(sceneChanged()), this, SLOT(reloadScene()));
+    connect(m_watcher.get(), SIGNAL(texturesChanged(QStringList)), this, SLOT(reloadTextures(QStringList)));
     connect(ui->actionOpen, SIGNAL(triggered()), this, SLOT(fileOpen()));
+    connect(ui->actionFrameStats, SIGNAL(toggled(bool)), this, SLOT(showFrameStats(bool)));
 }
 
 MainWindow::~MainWindow()
@@ -25,19 +38,67 @@ void MainWindow::fileOpen() {
         return;
     }
 
-    if (!file.endsWith(".json")) {
+    std::string path = withoutCompressionSuffix(file.toStdString());
+    if (!path.ends_with(".json") && !path.ends_with(".cbor")) {
         QMessageBox::warning(this, "Error", "Unsupported file format");
         return;
     }
 
+    // Scenes too large to load at once are paged by camera distance
+    if (file.endsWith(".json") && QFileInfo(file).size() >= PagedSceneSize) {
+        auto pager = std::make_unique<ScenePager>();
+        pager->setMemoryBudget(PagingBudget);
+        if (!pager->open(file.toStdString())) {
+            QMessageBox::critical(this, "Error", "Parse scene fail");
+            return;
+        }
+        ui->glwidget->loadScene(pager->baseData());
+        ui->glwidget->setPager(pager.get());
+        m_pager = std::move(pager);
+        m_scenePath.clear();
+        m_watcher->stop();
+        return;
+    }
+
     RenderData renderData;
     bool success = SceneParser::parse(file.toStdString(), renderData);
     if (!success) {
-        QMessageBox::critical(this, "Error", "Parse JSON fail");
+        QMessageBox::critical(this, "Error", "Parse scene fail");
         return;
     }
 
     // load the scene
     ui->glwidget->loadScene(renderData);
+    m_pager.reset();
+    m_scenePath = file.toStdString();
+    watchScene(ui->actionWatch->isChecked());
+}
+
+void MainWindow::showFrameStats(bool show) {
+    ui->glwidget->setStatsOverlay(show);
+}
+
+void MainWindow::watchScene(bool watch) {
+    // Paged scenes are never loaded whole, so they cannot be diffed
+    if (watch && !m_scenePath.empty()) {
+        m_watcher->watch(m_scenePath, ui->glwidget->renderData());
+    }
+    else {
+        m_watcher->stop();
+    }
+}
+
+void MainWindow::reloadScene() {
+    RenderData renderData;
+    if (m_watcher->takeScene(renderData)) {
+        ui->glwidget->reloadScene(renderData);
+    }
 }
 
+void MainWindow::reloadTextures(const QStringList &paths) {
+    std::vector<std::string> files;
+    for (const QString &path : paths) {
+        files.push_back(path.toStdString());
+    }
+    ui->glwidget->reloadTextures(files);
+}
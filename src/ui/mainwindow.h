@@ -3,6 +3,12 @@
 
 #include <QMainWindow>
 
+#include <memory>
+#include <string>
+
+class ScenePager;
+class SceneWatcher;
+
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
@@ -17,8 +23,15 @@ public:
 
 public slots:
     void fileOpen();
+    void showFrameStats(bool show);
+    void watchScene(bool watch);
+    void reloadScene();
+    void reloadTextures(const QStringList &paths);
 
 private:
     Ui::MainWindow *ui;
+    std::unique_ptr<ScenePager> m_pager;
+    std::unique_ptr<SceneWatcher> m_watcher;
+    std::string m_scenePath; // Empty unless a scene which can be watched is loaded
 };
 #endif // MAINWINDOW_H